@@ -25,6 +25,20 @@
 #define DESKTOPS        4         /* number of desktops - edit DESKTOPCHANGE keys to suit */
 #define DEFAULT_DESKTOP 0         /* the desktop to focus on exec */
 #define MINWSZ          50        /* minimum window size in pixels */
+#define SNAP            10        /* snap moved windows to edges closer than this in pixels - 0 to disable */
+#define STACK_SLOTS     0         /* stack windows shown at once in tile and bstack modes, the rest scroll with focus - 0 to show all */
+#define GRID_CELLS      8         /* cells per axis of the grid indexing the windows' geometry */
+#define EVENT_RATE      20        /* events per second a window may send for each event class */
+#define EVENT_BURST     10        /* events a window may send at once before being throttled */
+#define BATCH_TIMEOUT   1000      /* milliseconds after which an uncommitted command batch is applied */
+#define BURST_TIMEOUT   20        /* milliseconds windows going away may hold back the layout while events keep coming */
+#define SAMPLE_INTERVAL 0         /* seconds between resource usage samples on stderr - 0 to disable */
+#define SHM_CLIENTS     256       /* clients published in the shared state - 0 to disable it */
+#define TITLE_INTERVAL  500       /* minimum milliseconds between publishing unfocused windows' titles */
+#define PUBLISH_INTERVAL 100      /* maximum milliseconds the shared state lags behind while events keep coming */
+#define LAUNCH_TIMEOUT  30        /* seconds a spawned command's first window is placed on the desktop it was launched from */
+#define STALL_TIMEOUT   0         /* milliseconds the main loop may stall before it is logged - 0 to disable */
+#define STALL_LOG       "monsterwm-stalls.log" /* the stall log's name in $XDG_RUNTIME_DIR */
 
 /* open applications to specified desktop with specified mode.
  * if desktop is negative, then current is assumed */
@@ -43,7 +57,8 @@ static const char *menucmd[] = { "dmenu_run", NULL };
 
 #define DESKTOPCHANGE(K,N) \
     {  MOD1,             K,              change_desktop, {.i = N}}, \
-    {  MOD1|ShiftMask,   K,              client_to_desktop, {.i = N}},
+    {  MOD1|ShiftMask,   K,              client_to_desktop, {.i = N}}, \
+    {  MOD1|CONTROL,     K,              toggle_tag,        {.i = N}},
 
 /** Shortcuts **/
 static key keys[] = {
@@ -62,6 +77,8 @@ static key keys[] = {
     {  MOD1|SHIFT,       XK_h,          rotate_filled,     {.i = -1}},
     {  MOD1|SHIFT,       XK_l,          rotate_filled,     {.i = +1}},
     {  MOD1,             XK_Tab,        last_desktop,      {NULL}},
+    {  MOD4,             XK_Tab,        recent_win,        {.i = +1}}, /* older windows */
+    {  MOD4|SHIFT,       XK_Tab,        recent_win,        {.i = -1}}, /* newer windows */
     {  MOD1,             XK_Return,     swap_master,       {NULL}},
     {  MOD1|SHIFT,       XK_j,          move_down,         {NULL}},
     {  MOD1|SHIFT,       XK_k,          move_up,           {NULL}},
@@ -72,6 +89,8 @@ static key keys[] = {
     {  MOD1|SHIFT,       XK_f,          switch_mode,       {.i = FLOAT}},
     {  MOD1|CONTROL,     XK_r,          quit,              {.i = 0}}, /* quit with exit value 0 */
     {  MOD1|CONTROL,     XK_q,          quit,              {.i = 1}}, /* quit with exit value 1 */
+    {  MOD1|SHIFT,       XK_r,          reload,            {NULL}},   /* reload the config module */
+    {  MOD1|CONTROL|SHIFT, XK_r,        restart,           {NULL}},   /* restart in place, keeping the windows */
     {  MOD1|SHIFT,       XK_Return,     spawn,             {.com = termcmd}},
     {  MOD4,             XK_v,          spawn,             {.com = menucmd}},
     {  MOD4,             XK_j,          moveresize,        {.v = (int []){   0,  25,   0,   0 }}}, /* move up    */
@@ -82,6 +101,14 @@ static key keys[] = {
     {  MOD4|SHIFT,       XK_k,          moveresize,        {.v = (int []){   0,   0,   0, -25 }}}, /* height shrink */
     {  MOD4|SHIFT,       XK_l,          moveresize,        {.v = (int []){   0,   0,  25,   0 }}}, /* width grow    */
     {  MOD4|SHIFT,       XK_h,          moveresize,        {.v = (int []){   0,   0, -25,   0 }}}, /* width shrink  */
+    {  MOD4|CONTROL,     XK_h,          focus_dir,         {.i = LEFT}},
+    {  MOD4|CONTROL,     XK_j,          focus_dir,         {.i = DOWN}},
+    {  MOD4|CONTROL,     XK_k,          focus_dir,         {.i = UP}},
+    {  MOD4|CONTROL,     XK_l,          focus_dir,         {.i = RIGHT}},
+    {  MOD4|CONTROL|SHIFT, XK_h,        swap_dir,          {.i = LEFT}},
+    {  MOD4|CONTROL|SHIFT, XK_j,        swap_dir,          {.i = DOWN}},
+    {  MOD4|CONTROL|SHIFT, XK_k,        swap_dir,          {.i = UP}},
+    {  MOD4|CONTROL|SHIFT, XK_l,        swap_dir,          {.i = RIGHT}},
        DESKTOPCHANGE(    XK_F1,                             0)
        DESKTOPCHANGE(    XK_F2,                             1)
        DESKTOPCHANGE(    XK_F3,                             2)
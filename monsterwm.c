@@ -3,27 +3,123 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <err.h>
+#include <errno.h>
 #include <stdarg.h>
 #include <unistd.h>
 #include <string.h>
 #include <signal.h>
+#include <limits.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/select.h>
 #include <sys/wait.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <execinfo.h>
+#if defined __GLIBC__ && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+#include <malloc.h>
+#define MALLINFO2
+#endif
 #include <X11/Xutil.h>
 #include <X11/XKBlib.h>
 #include <X11/Xproto.h>
 #include <X11/Xatom.h>
+#ifdef XINPUT2
+#include <X11/extensions/XInput2.h>
+#endif
+#ifdef USDT
+#include <sys/sdt.h>
+#endif
 
 #define LENGTH(x)       (sizeof(x)/sizeof(*x))
 #define CLEANMASK(mask) (mask & ~(numlockmask | LockMask))
 #define BUTTONMASK      ButtonPressMask|ButtonReleaseMask
+/* the state bits of the buttons held */
+#define HELDMASK        (Button1Mask|Button2Mask|Button3Mask|Button4Mask|Button5Mask)
+/* the events a client reports while shown, and while hidden or covered */
+#define CLIENTMASK      (PropertyChangeMask|FocusChangeMask|(FOLLOW_MOUSE && !xiopcode ? EnterWindowMask:0))
+#define HIDDENMASK      PropertyChangeMask
+/* the events the root window reports, and property changes while input waits for its timestamp */
+#define ROOTMASK        (SubstructureRedirectMask|ButtonPressMask|SubstructureNotifyMask)
+/* the events a container reports, it covers the root so presses on the empty desktop land on it */
+#define CONTAINERMASK   (SubstructureRedirectMask|ButtonPressMask|SubstructureNotifyMask)
 #define ISFFT(c)        (c->isfullscrn || c->isfloating || c->istransient)
+/* whether a client of the selected desktop is floating in effect */
+#define ISFLT(c)        (!c->isfullscrn && (c->isfloating || c->istransient || mode == FLOAT))
+/* the grid cell in which a coordinate lies, given the screen size on that axis */
+#define CELL(v, s)      ((v) < 0 ? 0:(v) >= (s) ? GRID_CELLS - 1:(v)*GRID_CELLS/(s))
+/* call a step of the main loop, naming it for the watchdog */
+#define STEP(f, args)   (loop.phase = #f, f args)
+/* alignment of scratch memory */
+#define ALIGN           16
+/* inputs whose resulting requests can wait for their timestamp at once */
+#define STAMPS          16
+/* launches whose window can be waited for at once, and commands whose
+ * launch latency is recorded */
+#define LAUNCHES        16
+/* size of the buffer holding a window's title, longer titles are cut */
+#define TITLE_LENGTH    128
+/* names tried for the shared state before giving up on it */
+#define SHM_NAMES       16
+/* size of the buffers holding a window's class and instance name */
+#define NAME_LENGTH     64
+/* version of the config structure, bumped whenever it or the types it holds change */
+#define CONFIG_ABI      1
+/* version of the state restart() hands over, bumped whenever it changes */
+#define RESTART_ABI     1
+/* the functions keys and buttons can be bound to in a configuration module */
+#define BINDABLE(X) X(change_desktop) X(client_to_desktop) X(focus_dir) X(focusurgent) X(jump) \
+    X(killclient) X(last_desktop) X(mousemotion) X(move_down) X(move_up) X(moveresize) X(next_win) X(prev_win)   \
+    X(quit) X(recent_win) X(reload) X(restart) X(resize_master) X(resize_stack) X(rotate) X(rotate_filled) X(spawn)          \
+    X(swap_dir) X(swap_master) X(switch_mode) X(toggle_tag) X(togglepanel)
+#define ADDRESS(f)      f,
+/* the requests the handlers make through the display backend */
+#define BACKEND(X) X(AddToSaveSet) X(AllocNamedColor) X(ChangeProperty) X(ConfigureWindow)          \
+    X(ConnectionNumber) X(CreateWindow) X(DefaultColormap) X(DefaultScreen) X(DeleteContext)      \
+    X(DeleteProperty) X(DisplayHeight) X(DisplayWidth) X(FindContext) X(GetClassHint)             \
+    X(GetModifierMapping) X(GetTextProperty) X(GetTransientForHint) X(GetWMHints)                 \
+    X(GetWMNormalHints) X(GetWMProtocols) X(GetWindowAttributes) X(GetWindowProperty)             \
+    X(GrabButton) X(GrabKey) X(GrabKeyboard) X(GrabPointer) X(InternAtom) X(KeysymToKeycode)      \
+    X(KillClient) X(LowerWindow) X(MapWindow) X(MoveResizeWindow) X(ParseColor) X(QueryPointer)   \
+    X(QueryTree) X(RaiseWindow) X(RemoveFromSaveSet) X(ReparentWindow) X(RestackWindows)          \
+    X(RootWindow) X(SaveContext) X(ScreenCount) X(SelectInput) X(SendEvent) X(SetInputFocus)      \
+    X(SetWindowBorder) X(SetWindowBorderWidth) X(Sync) X(UngrabButton) X(UngrabKey)               \
+    X(UngrabKeyboard) X(UngrabPointer) X(UnmapWindow) X(WarpPointer)
+/* the screen macros read the display structure, here they are the backend's
+ * ops, which Xlib has as functions of the same names */
+#undef ConnectionNumber
+#undef DefaultColormap
+#undef DefaultScreen
+#undef DisplayHeight
+#undef DisplayWidth
+#undef RootWindow
+#undef ScreenCount
+#define XLIB(f)         .f = X##f,
 /* wrapper to automatically move/resize windows used by multi-monitor branch */
-#define XMVRSZ(dis, win, x, y, w, h) XMoveResizeWindow(dis, win, 0 + (x), 0 + (y), w, h)
+#define XMVRSZ(dis, win, x, y, w, h) be->MoveResizeWindow(dis, win, 0 + (x), 0 + (y), w, h)
+/* static probes for perf and bpftrace - every probe carries the window id,
+ * the current desktop and the number of managed clients, event probes also
+ * carry the event type first. they compile to nothing unless built with USDT */
+#ifdef USDT
+#define PROBE(name, win)             DTRACE_PROBE3(monsterwm, name, win, current_desktop, nclients)
+#define PROBE_EVENT(name, type, win) DTRACE_PROBE4(monsterwm, name, type, win, current_desktop, nclients)
+#else
+#define PROBE(name, win)
+#define PROBE_EVENT(name, type, win)
+#endif
 
 enum { RESIZE, MOVE };
+enum { LEFT, RIGHT, UP, DOWN };
 enum { TILE, MONOCLE, BSTACK, GRID, FLOAT, MODES };
 enum { WM_PROTOCOLS, WM_DELETE_WINDOW, WM_COUNT };
-enum { NET_SUPPORTED, NET_FULLSCREEN, NET_WM_STATE, NET_ACTIVE, NET_COUNT };
+enum { NET_SUPPORTED, NET_FULLSCREEN, NET_WM_STATE, NET_ACTIVE, NET_WM_NAME, NET_COUNT };
+enum { EV_HINTS, EV_ACTIVE, EV_CONFIG, EV_CLASSES };
+enum { CMD_BEGIN, CMD_COMMIT, CMD_DESKTOP, CMD_MODE, CMD_MASTER, CMD_SWAP, CMD_FOCUS, CMD_RELOAD,
+       CMD_QUERY, CMD_JUMP, CMD_RESTART };
+enum { SHM_URGENT = 1, SHM_TRANSIENT = 2, SHM_FULLSCRN = 4, SHM_FLOATING = 8 };
 
 /* argument structure to be passed to function by config.h
  * com  - a command to run
@@ -60,6 +156,15 @@ typedef struct {
     const Arg arg;
 } Button;
 
+/* a cell of a desktop's spatial grid
+ * c    - the clients whose geometry overlaps the cell
+ * n    - the number of those clients
+ * size - the allocated size of c */
+typedef struct cell {
+    struct client **c;
+    int n, size;
+} cell;
+
 /* a client is a wrapper to a window that additionally
  * holds some properties for that window
  *
@@ -69,6 +174,29 @@ typedef struct {
  * isfullscrn  - set when the window is fullscreen
  * isfloating  - set when the window is floating
  * win         - the window this client is representing
+ * x, y, w, h  - the last geometry the window was given or requested
+ * cells       - the spatial grid cells of the client's desktop
+ * gx, gy      - the first grid cell the client is indexed in
+ * gw, gh      - the number of grid cells the client spans, 0 if not indexed
+ * mark        - the last grid query that has seen the client
+ * unmaps      - unmap notifications caused by the wm, to be ignored
+ * paged       - whether the window is a stack window scrolled off the page
+ * tokens      - token bucket of each event class, refilled at EVENT_RATE per second
+ * stamp       - when each bucket was last refilled, in milliseconds
+ * throttled   - how many events of each class went over budget
+ * deferred    - mask of event classes waiting for their trailing update
+ * tags        - mask of the desktops the window is shown on, 0 if only its own
+ * desktop     - the desktop a tagged window lives on
+ * newtitle    - set when the title changed since it was last read
+ * title       - the window's title as last read
+ * class       - the window's class name
+ * instance    - the window's instance name
+ * key         - the class, instance and title in lower case, each ending
+ *               with a newline, that searches look in
+ * slot        - the client's position in the search index
+ * mask        - the events the window is selected for, see selectmask()
+ * older, newer - the clients focused before and after this one on its desktop
+ * golder, gnewer - the same in the focus history of all desktops
  *
  * istransient is separate from isfloating as floating window can be reset
  * to their tiling positions, while the transients will always be floating
@@ -77,24 +205,85 @@ typedef struct client {
     struct client *next;
     Bool isurgent, istransient, isfullscrn, isfloating;
     Window win;
+    int x, y, w, h;
+    cell *cells;
+    int gx, gy, gw, gh;
+    unsigned int mark;
+    int unmaps;
+    Bool paged;
+    float tokens[EV_CLASSES];
+    long stamp[EV_CLASSES];
+    unsigned int throttled[EV_CLASSES], deferred;
+    unsigned int tags;
+    int desktop;
+    Bool newtitle;
+    char title[TITLE_LENGTH];
+    char class[NAME_LENGTH], instance[NAME_LENGTH];
+    char key[2*NAME_LENGTH + TITLE_LENGTH];
+    int slot;
+    long mask;
+    struct client *older, *newer, *golder, *gnewer;
 } client;
 
+/* the windows tagged with a desktop, shown on it besides its own
+ * a desktop is viewed through its container window, one at a time, so the
+ * tagged windows that live on other desktops are moved into it when it is
+ * viewed, and its client list is then the list of the windows it shows
+ * c    - the tagged clients, in no order
+ * n    - the number of them
+ * size - the allocated size of c */
+typedef struct view {
+    client **c;
+    int n, size;
+} view;
+
 /* properties of each desktop
  * master_size  - the size of the master window
  * mode         - the desktop's tiling layout mode
  * growth       - growth factor of the first stack window
+ * scroll       - the first stack window on the page, with STACK_SLOTS
  * head         - the start of the client list
  * current      - the currently highlighted window
- * prevfocus    - the client that previously had focus
+ * recent       - the most recently focused client, the front of the focus
+ *                history linked through the clients' older and newer
  * showpanel    - the visibility status of the panel
+ * cells        - GRID_CELLS x GRID_CELLS cells indexing the clients' geometry
+ * container    - the window the desktop's clients are reparented into
  */
 typedef struct {
-    int mode, growth;
+    int mode, growth, scroll;
     float master_size;
-    client *head, *current, *prevfocus;
+    client *head, *current, *recent;
     Bool showpanel;
+    cell *cells;
+    Window container;
 } desktop;
 
+/* an X screen of the display, with its own set of desktops
+ * the selected screen's state lives in the globals, like the selected
+ * desktop's does, and is saved here when another screen is selected
+ *
+ * root             - the screen's root window
+ * num              - the screen number
+ * ww, wh           - the screen's width, and height less the panel
+ * current_desktop  - the screen's focused desktop
+ * previous_desktop - the screen's previously focused desktop
+ * visible          - the screen's desktop whose container is mapped
+ * stale            - the screen's hidden desktops whose layout is stale
+ * touched          - the screen's desktops touched by the open batch
+ * focus, unfocus   - the border colors in the screen's colormap
+ * desktops         - the screen's DESKTOPS desktops
+ * views            - the windows tagged with each of the screen's desktops
+ */
+typedef struct {
+    Window root;
+    int num, ww, wh, current_desktop, previous_desktop, visible;
+    unsigned int stale, touched;
+    unsigned long focus, unfocus;
+    desktop *desktops;
+    view *views;
+} xscreen;
+
 /* define behavior of certain applications
  * configured in config.h
  * class    - the class or name of the instance
@@ -107,73 +296,471 @@ typedef struct {
     const Bool follow, floating;
 } AppRule;
 
+/* the desktop state published in shared memory for bars and widgets
+ *
+ * the region starts with a header, followed by ndesktops desktop
+ * entries, followed by nclients client entries, all in native order.
+ * the writer makes seq odd while updating, so a reader copies what it
+ * needs, and retries if seq was odd or changed during the copy
+ *
+ * seq       - the sequence lock, bumped twice on every update
+ * version   - the layout version of the region, currently 3
+ * ndesktops - the number of desktop entries, DESKTOPS for every screen
+ * nclients  - the number of client entries, at most SHM_CLIENTS
+ * desktop   - the current desktop of the selected screen
+ * focus     - the window id of the focused client, or 0
+ *
+ * each desktop entry holds its client count, mode, urgent and panel state,
+ * counting the windows tagged with it that live on other desktops
+ * each client entry holds its window id, the desktop it lives on, SHM_* flags,
+ * the mask of its screen's desktops it is tagged with, 0 if only its own,
+ * geometry and nul terminated title, published at most every TITLE_INTERVAL
+ * milliseconds unless it is the focused window's */
+typedef struct {
+    uint32_t seq, version, ndesktops, nclients, desktop, focus;
+} shmheader;
+
+typedef struct {
+    uint32_t clients, mode, urgent, showpanel;
+} shmdesktop;
+
+typedef struct {
+    uint32_t win, desktop, flags, tags;
+    int32_t x, y, w, h;
+    char title[TITLE_LENGTH];
+} shmclient;
+
+/* the state restart() hands over to the process replacing it, in an
+ * unlinked shared memory object whose descriptor survives the exec
+ *
+ * the object starts with a header, followed for each screen by a screen
+ * entry and, for each of its desktops, a desktop entry followed by its
+ * nclients client entries in list order and the nrecent windows of its
+ * focus history, newest first. last come nlatest and the windows of the
+ * focus history of all desktops, newest first
+ *
+ * abi        - RESTART_ABI
+ * clientsize - the size of a client entry, so that a changed one is refused
+ * container  - a container of the replaced process, whose resources are
+ *              destroyed once its windows have been taken over
+ *
+ * the desktop and client entries hold the fields of the same name */
+typedef struct {
+    unsigned int abi, clientsize;
+    int nscreens, desktops;
+    Window container;
+} restartheader;
+
+typedef struct {
+    int visible, previous_desktop;
+} restartscreen;
+
+typedef struct {
+    int mode, growth, scroll, nclients, nrecent;
+    float master_size;
+    Bool showpanel;
+} restartdesktop;
+
+typedef struct {
+    Window win;
+    Bool isurgent, istransient, isfullscrn, isfloating, paged;
+    int x, y, w, h, desktop;
+    unsigned int tags;
+    char title[TITLE_LENGTH], class[NAME_LENGTH], instance[NAME_LENGTH];
+} restartclient;
+
+/* a latency histogram
+ * n      - the number of samples
+ * max    - the longest sample in microseconds
+ * bucket - the number of samples of each power of two microseconds */
+typedef struct {
+    unsigned long n, max, bucket[32];
+} histogram;
+
+/* an input whose resulting requests wait for their server timestamp
+ * fn   - the index of the function the input is bound to in bindings
+ * time - the server time of the key or button press */
+typedef struct {
+    int fn;
+    Time time;
+} inputstamp;
+
+/* a command started by spawn() whose window is waited for
+ * id      - the startup id it was given, empty if the launch is free
+ * cmd     - the command's name
+ * pid     - the process it runs in
+ * screen  - the screen it was launched from
+ * desktop - the desktop it was launched from
+ * time    - when it was launched, in microseconds */
+typedef struct {
+    char id[64], cmd[32];
+    pid_t pid;
+    int screen, desktop;
+    long time;
+} launch;
+
+/* the latency from launch to map of a command's windows
+ * cmd     - the command's name, empty if unused
+ * latency - the launch to map time in microseconds
+ * expired - how many launches got no window within LAUNCH_TIMEOUT */
+typedef struct {
+    char cmd[32];
+    histogram latency;
+    unsigned long expired;
+} launchstat;
+
+/* a move or resize with the mouse, started by mousemotion() and carried
+ * on by the events run() dispatches
+ * c          - the dragged client, NULL if there is no drag
+ * how        - MOVE or RESIZE
+ * screen     - the screen the client is on
+ * rx, ry     - the pointer's position when the drag started
+ * x, y       - the pointer's last reported position
+ * dev        - the master pointer dragging, with XInput2
+ * moved      - whether the pointer moved since the window was last updated
+ * floating   - whether the client was floating before the drag
+ * fullscrn   - whether the client was fullscreen before the drag
+ * wa         - the client's geometry when the drag started */
+typedef struct {
+    struct client *c;
+    int how, screen, rx, ry, x, y, dev;
+    Bool moved, floating, fullscrn;
+    XWindowAttributes wa;
+} dragstate;
+
+/* what the main loop is doing, shared with the watchdog thread
+ * heartbeat - bumped on every iteration and every event handled
+ * busy      - whether the loop is working rather than waiting for events
+ * phase     - the name of the step being run
+ * type      - the type of the event being handled, 0 if none
+ * win       - the window of the event being handled
+ * stalls    - how many times the loop stalled over STALL_TIMEOUT
+ * stalled   - the total and longest stall time in milliseconds */
+typedef struct {
+    volatile unsigned long heartbeat;
+    volatile sig_atomic_t busy;
+    const char *volatile phase;
+    volatile int type;
+    volatile Window win;
+    volatile unsigned long stalls, stalled, longest;
+} loopstate;
+
+/* the scratch arena, a bump allocator for memory that is only needed
+ * until the current batch of events has been handled
+ * buf     - the memory, grown to the peak use of previous batches
+ * size    - the size of buf
+ * used    - how much of buf is in use
+ * spilled - how much memory did not fit in buf in this batch
+ * peak    - the most memory ever needed in a batch
+ * spills  - how many times memory did not fit in buf
+ * extra   - the chunks allocated for memory that did not fit, each
+ *           starting with a pointer to the next, padded to ALIGN */
+typedef struct {
+    char *buf;
+    size_t size, used, spilled, peak;
+    unsigned long spills;
+    void *extra;
+} scratcharena;
+
+/* the settings that can be changed without rebuilding the wm, either
+ * compiled in from config.h or loaded from a configuration module
+ *
+ * abi         - the CONFIG_ABI the configuration was built with
+ * keys        - the key bindings, nkeys of them
+ * buttons     - the button bindings, nbuttons of them
+ * rules       - the application rules, nrules of them
+ * mastersize  - MASTER_SIZE
+ * borderwidth - BORDER_WIDTH
+ * focus       - FOCUS, the focused window border color
+ * unfocus     - UNFOCUS, the unfocused window border color
+ * bindings    - the module's stand-ins of the BINDABLE functions, nbindings of them
+ */
+typedef struct {
+    unsigned int abi;
+    key *keys;
+    unsigned int nkeys;
+    Button *buttons;
+    unsigned int nbuttons;
+    const AppRule *rules;
+    unsigned int nrules;
+    float mastersize;
+    int borderwidth;
+    const char *focus, *unfocus;
+    void (*const *bindings)(const Arg *);
+    unsigned int nbindings;
+} config;
+
+/* the display backend, the X requests the handlers make, with the
+ * signatures of the Xlib functions of the same name. the Xlib backend is
+ * those functions, the mock backend models the windows in memory */
+typedef struct {
+    int (*AddToSaveSet)(Display *, Window);
+    Status (*AllocNamedColor)(Display *, Colormap, const char *, XColor *, XColor *);
+    int (*ChangeProperty)(Display *, Window, Atom, Atom, int, int, const unsigned char *, int);
+    int (*ConfigureWindow)(Display *, Window, unsigned int, XWindowChanges *);
+    int (*ConnectionNumber)(Display *);
+    Window (*CreateWindow)(Display *, Window, int, int, unsigned int, unsigned int, unsigned int, int,
+                           unsigned int, Visual *, unsigned long, XSetWindowAttributes *);
+    Colormap (*DefaultColormap)(Display *, int);
+    int (*DefaultScreen)(Display *);
+    int (*DeleteContext)(Display *, XID, XContext);
+    int (*DeleteProperty)(Display *, Window, Atom);
+    int (*DisplayHeight)(Display *, int);
+    int (*DisplayWidth)(Display *, int);
+    int (*FindContext)(Display *, XID, XContext, XPointer *);
+    int (*GetClassHint)(Display *, Window, XClassHint *);
+    XModifierKeymap* (*GetModifierMapping)(Display *);
+    Status (*GetTextProperty)(Display *, Window, XTextProperty *, Atom);
+    Status (*GetTransientForHint)(Display *, Window, Window *);
+    XWMHints* (*GetWMHints)(Display *, Window);
+    Status (*GetWMNormalHints)(Display *, Window, XSizeHints *, long *);
+    Status (*GetWMProtocols)(Display *, Window, Atom **, int *);
+    Status (*GetWindowAttributes)(Display *, Window, XWindowAttributes *);
+    int (*GetWindowProperty)(Display *, Window, Atom, long, long, Bool, Atom, Atom *, int *,
+                             unsigned long *, unsigned long *, unsigned char **);
+    int (*GrabButton)(Display *, unsigned int, unsigned int, Window, Bool, unsigned int, int, int, Window, Cursor);
+    int (*GrabKey)(Display *, int, unsigned int, Window, Bool, int, int);
+    int (*GrabKeyboard)(Display *, Window, Bool, int, int, Time);
+    int (*GrabPointer)(Display *, Window, Bool, unsigned int, int, int, Window, Cursor, Time);
+    Atom (*InternAtom)(Display *, const char *, Bool);
+    KeyCode (*KeysymToKeycode)(Display *, KeySym);
+    int (*KillClient)(Display *, XID);
+    int (*LowerWindow)(Display *, Window);
+    int (*MapWindow)(Display *, Window);
+    int (*MoveResizeWindow)(Display *, Window, int, int, unsigned int, unsigned int);
+    Status (*ParseColor)(Display *, Colormap, const char *, XColor *);
+    Bool (*QueryPointer)(Display *, Window, Window *, Window *, int *, int *, int *, int *, unsigned int *);
+    Status (*QueryTree)(Display *, Window, Window *, Window *, Window **, unsigned int *);
+    int (*RaiseWindow)(Display *, Window);
+    int (*RemoveFromSaveSet)(Display *, Window);
+    int (*ReparentWindow)(Display *, Window, Window, int, int);
+    int (*RestackWindows)(Display *, Window *, int);
+    Window (*RootWindow)(Display *, int);
+    int (*SaveContext)(Display *, XID, XContext, const char *);
+    int (*ScreenCount)(Display *);
+    int (*SelectInput)(Display *, Window, long);
+    Status (*SendEvent)(Display *, Window, Bool, long, XEvent *);
+    int (*SetInputFocus)(Display *, Window, int, Time);
+    int (*SetWindowBorder)(Display *, Window, unsigned long);
+    int (*SetWindowBorderWidth)(Display *, Window, unsigned int);
+    int (*Sync)(Display *, Bool);
+    int (*UngrabButton)(Display *, unsigned int, unsigned int, Window);
+    int (*UngrabKey)(Display *, int, unsigned int, Window);
+    int (*UngrabKeyboard)(Display *, Time);
+    int (*UngrabPointer)(Display *, Time);
+    int (*UnmapWindow)(Display *, Window);
+    int (*WarpPointer)(Display *, Window, Window, int, int, unsigned int, unsigned int, int, int);
+} backend;
+
+#ifdef MODULE
+/* built as a configuration module only config.h is compiled, along with
+ * stand-ins for the functions it binds, that the wm maps back on load */
+#define STANDIN(f)      static void f(const Arg *arg) { (void)arg; }
+BINDABLE(STANDIN)
+
+#include "config.h"
+
+static void (*const standins[])(const Arg *) = { BINDABLE(ADDRESS) };
+const config monsterwm_config = { CONFIG_ABI, keys, LENGTH(keys), buttons, LENGTH(buttons),
+                                  rules, LENGTH(rules), MASTER_SIZE, BORDER_WIDTH, FOCUS, UNFOCUS,
+                                  standins, LENGTH(standins) };
+#else
+
 /* function prototypes sorted alphabetically */
 static client* addwindow(Window w);
 static void buttonpress(XEvent *e);
+static void buttonrelease(XEvent *e);
 static void change_desktop(const Arg *arg);
 static void cleanup(void);
 static void client_to_desktop(const Arg *arg);
 static void clientmessage(XEvent *e);
+static void command(XEvent *e);
+static void commit(void);
 static void configurerequest(XEvent *e);
 static void deletewindow(Window w);
 static void desktopinfo(void);
 static void destroynotify(XEvent *e);
+static int detach(client *c);
+static void dragmove(void);
+static void enddrag(Bool cancel);
 static void enternotify(XEvent *e);
+static client* findclient(Window w, int *d);
+static void flushdeferred(void);
+static void focus_dir(const Arg *arg);
 static void focusin(XEvent *e);
 static void focusurgent();
+static void forget(client *c, Bool all);
 static unsigned long getcolor(const char* color);
+static Bool gettitle(client *c);
 static void grabbuttons(client *c);
 static void grabkeys(void);
 static void grid(int h, int y);
+static void jump(const Arg *arg);
+static void jumpto(client *c);
 static void keypress(XEvent *e);
+static void keyrelease(XEvent *e);
 static void killclient();
 static void last_desktop();
+static int launchdesktop(Window w);
+static launchstat* launchstatfor(const char *cmd);
+static const config* loadconfig(const char *path);
+static char* lowered(const char *s);
 static void maprequest(XEvent *e);
+static Bool matches(const char *key, const char *q, Bool prefix);
 static void monocle(int h, int y);
+static void motionnotify(XEvent *e);
+static void mousemotion(const Arg *arg);
 static void move_down();
 static void move_up();
 static void moveresize(const Arg *arg);
-static void mousemotion(const Arg *arg);
+static long mstime(void);
+static int nearby(int x, int y, int w, int h);
+static client* neighbour(int dir);
 static void next_win();
+static void openburst(void);
+static void* openmodule(const char *path);
+static long overlap(client *c, int x, int y);
+static long percentile(histogram *h, int p);
+static void place(client *c);
+static Bool prelayout(void);
 static client* prev_client(client *c);
 static void prev_win();
+static void promote(client *c);
 static void propertynotify(XEvent *e);
+static void publish(void);
+static void query(Bool jump, Bool prefix);
 static void quit(const Arg *arg);
+static void recent_win(const Arg *arg);
+static void record(histogram *h, long us);
+static void reindex(client *c);
+static void rekey(client *c);
+static void reload();
+static void remember(client *c);
 static void removeclient(client *c);
+static void resize(client *c, int x, int y, int w, int h);
 static void resize_master(const Arg *arg);
 static void resize_stack(const Arg *arg);
+static void restart();
+static void resume(int fd);
+static void retitle(Bool all);
 static void rotate(const Arg *arg);
 static void rotate_filled(const Arg *arg);
 static void run(void);
+static void sample(void);
 static void save_desktop(int i);
+static void* scratch(size_t n);
+static void scratchreset(void);
+static client* search(const char *q, Bool prefix, client *after);
 static void select_desktop(int i);
+static void select_screen(int i);
+static void selectmask(client *c, Bool seen);
+static void sendtodesktop(client *c, int d);
 static void setfullscreen(client *c, Bool fullscrn);
+static void setpaged(client *c, Bool paged);
+static void settags(client *c, unsigned int tags);
 static void setup(void);
+static void setupshm(void);
 static void sigchld();
+static void sigusr1();
+static void sigusr2();
+static void snap(client *c, int *x, int *y);
 static void spawn(const Arg *arg);
 static void stack(int h, int y);
+static void stamp(void (*func)(const Arg *), Time t);
+static void stats(void);
+static void swap_dir(const Arg *arg);
 static void swap_master();
 static void switch_mode(const Arg *arg);
+static Bool throttle(client *c, int ev);
 static void tile(void);
+static long timeout(void);
+static void toggle_tag(const Arg *arg);
 static void togglepanel();
-static void update_current(client *c);
+static void unindex(client *c);
 static void unmapnotify(XEvent *e);
+static void update_current(client *c);
+static Bool urgenthint(Window w);
+static long ustime(void);
+static void* watchdog(void *unused);
 static client* wintoclient(Window w);
 static int xerror(Display *dis, XErrorEvent *ee);
 static int xerrorstart();
+#ifdef XINPUT2
+static Bool xidragstart(int how);
+static void xievent(XEvent *e);
+static void xiselect(Window w, unsigned int events);
+#endif
 
 #include "config.h"
 
-static Bool running = True, showpanel = SHOW_PANEL;
-static int previous_desktop = 0, current_desktop = 0, retval = 0;
-static int screen, wh, ww, mode = DEFAULT_MODE, master_size = 0, growth = 0;
+/* the compiled in configuration, and the one in effect */
+static void (*const bindings[])(const Arg *) = { BINDABLE(ADDRESS) };
+static const config builtin = { CONFIG_ABI, keys, LENGTH(keys), buttons, LENGTH(buttons),
+                                rules, LENGTH(rules), MASTER_SIZE, BORDER_WIDTH, FOCUS, UNFOCUS,
+                                bindings, LENGTH(bindings) };
+static const config *cfg = &builtin;
+static void *module = NULL;
+/* the arguments the wm was started with, to start it again on restart() */
+static char **arguments;
+
+/* the display backend in use, Xlib unless built with MOCK, see bench() */
+static const backend xlib = { BACKEND(XLIB) };
+static const backend *be = &xlib;
+
+/* the bound functions' names, and the latency from the input that called
+ * them to the server having processed their requests */
+#define NAME(f)         #f,
+static const char *bindingnames[] = { BINDABLE(NAME) };
+static histogram inputlatency[LENGTH(bindings)];
+static inputstamp stamps[STAMPS];
+static unsigned int firststamp = 0, nstamps = 0, stamping = 0;
+static Time inputtime = CurrentTime;
+static launch launches[LAUNCHES];
+static launchstat launchstats[LAUNCHES];
+static unsigned long launchseq = 0;
+static int nlaunches = 0;
+
+static Bool running = True, showpanel = SHOW_PANEL, cycling = False;
+static Bool deferred = False, dirty = False, batch = False, pendinginfo = False, burst = False;
+static volatile sig_atomic_t dumpstats = 0;
+static long deadline = 0, batchend = 0, started = 0, nextsample = 0, titledue = 0, published = 0;
+static unsigned long allocated = 0, freed = 0, wakeups = 0, samplewakeups = 0;
+static histogram evlatency, samplelatency;
+static scratcharena arena;
+static loopstate loop;
+static dragstate moving;
+static FILE *stalllog;
+static pthread_t mainthread;
+static unsigned int touched = 0, stale = 0;
+static int previous_desktop = 0, current_desktop = 0, visible = 0, retval = 0, nclients = 0;
+static int screen, wh, ww, mode = DEFAULT_MODE, master_size = 0, growth = 0, scroll = 0;
+/* the XInput2 extension's major opcode, 0 if the core protocol is used */
+static int xiopcode = 0;
 static int (*xerrorxlib)(Display *, XErrorEvent *);
 static unsigned int numlockmask = 0, win_unfocus, win_focus;
 static Display *dis;
-static Window root;
-static client *head, *prevfocus, *current;
-static Atom wmatoms[WM_COUNT], netatoms[NET_COUNT];
-static desktop desktops[DESKTOPS];
+static Window root, container;
+static shmheader *shm;
+static char shmname[32], shown[TITLE_LENGTH];
+static client *head, *recent, *current, **nearbyfound;
+/* the front of the focus history of all desktops, and the client cycled
+ * to in it, see recent_win() */
+static client *latest, *cycled;
+static cell *cells;
+static unsigned int marks = 0, nfound = 0;
+static Atom wmatoms[WM_COUNT], netatoms[NET_COUNT], cmdatom, stampatom, queryatom, matchatom;
+static Atom startupatom, pidatom;
+static desktop *desktops;
+/* the windows tagged with each desktop, the ones it shows besides its own */
+static view *views;
+/* the screens, the selected one, and the context mapping the roots,
+ * containers and clients to the screen they are on */
+static xscreen *screens;
+static int nscreens = 0, cs = 0;
+static XContext screenctx, clientctx;
+/* the search index, the clients of every screen and desktop in no order */
+static client **byname;
+static int nbyname = 0, bynamesize = 0;
 
 /* events array - on new event, call the appropriate handling function */
 static void (*events[LASTEvent])(XEvent *e) = {
@@ -182,6 +769,11 @@ static void (*events[LASTEvent])(XEvent *e) = {
     [ButtonPress]      = buttonpress,  [DestroyNotify]  = destroynotify,
     [UnmapNotify]      = unmapnotify,  [PropertyNotify] = propertynotify,
     [ConfigureRequest] = configurerequest,    [FocusIn] = focusin,
+    [MotionNotify]     = motionnotify, [ButtonRelease]  = buttonrelease,
+    [KeyRelease]       = keyrelease,
+#ifdef XINPUT2
+    [GenericEvent]     = xievent,
+#endif
 };
 
 /* layout array - given the current layout mode, tile the windows
@@ -196,60 +788,113 @@ static void (*layout[MODES])(int h, int y) = {
 client* addwindow(Window w) {
     client *c, *t = prev_client(head);
     if (!(c = (client *)calloc(1, sizeof(client)))) err(EXIT_FAILURE, "cannot allocate client");
+    allocated++;
+    c->cells = cells;
+    for (int ev=0; ev<EV_CLASSES; ev++) { c->tokens[ev] = EVENT_BURST; c->stamp[ev] = mstime(); }
 
     if (!head) head = c;
     else if (!ATTACH_ASIDE) { c->next = head; head = c; }
     else if (t) t->next = c; else head->next = c;
 
-    XSelectInput(dis, (c->win = w), PropertyChangeMask|FocusChangeMask|(FOLLOW_MOUSE?EnterWindowMask:0));
+    c->win = w;
+    selectmask(c, current_desktop == visible);
+    be->SaveContext(dis, w, screenctx, (XPointer)(intptr_t)cs);
+    be->SaveContext(dis, w, clientctx, (XPointer)c);
+    if (nbyname == bynamesize && !(byname = realloc(byname, (bynamesize = 2*bynamesize + 16)*sizeof(client *))))
+        err(EXIT_FAILURE, "cannot allocate search index");
+    byname[c->slot = nbyname++] = c;
+    nclients++;
+    PROBE(client__add, w);
     return c;
 }
 
-/* on the press of a button check to see if there's a binded function to call */
+/* on the press of a button check to see if there's a binded function to call
+ * during a drag the pointer is grabbed on the root window, and the presses
+ * reported there, or on the visible container covering it, are the dragged
+ * window's, so another binding takes over.
+ * only the first binding that matches is called, as it may reload them */
 void buttonpress(XEvent *e) {
     client *c = wintoclient(e->xbutton.window);
+    void (*f)(const Arg *);
+    if (!c && moving.c && (e->xbutton.window == root || e->xbutton.window == container)) c = moving.c;
     if (!c) return;
     if (CLICK_TO_FOCUS && current != c && e->xbutton.button == Button1) update_current(c);
 
-    for (unsigned int i=0; i<LENGTH(buttons); i++)
-        if (buttons[i].func && buttons[i].button == e->xbutton.button &&
-            CLEANMASK(buttons[i].mask) == CLEANMASK(e->xbutton.state)) {
+    for (unsigned int i=0; i<cfg->nbuttons; i++)
+        if ((f = cfg->buttons[i].func) && cfg->buttons[i].button == e->xbutton.button &&
+            CLEANMASK(cfg->buttons[i].mask) == CLEANMASK(e->xbutton.state & ~HELDMASK)) {
             if (current != c) update_current(c);
-            buttons[i].func(&(buttons[i].arg));
+            inputtime = e->xbutton.time;
+            f(&(cfg->buttons[i].arg));
+            stamp(f, e->xbutton.time);
+            return;
         }
 }
 
+/* the button was released, the drag is over once the window is where the
+ * pointer last was, unless another button that took the drag over is held */
+void buttonrelease(XEvent *e) {
+    unsigned int held = e->xbutton.state & HELDMASK;
+    if (!moving.c) return;
+    moving.x = e->xbutton.x_root; moving.y = e->xbutton.y_root;
+    if (held & ~(Button1Mask << (e->xbutton.button - 1))) { moving.moved = True; return; }
+    dragmove();
+    enddrag(False);
+}
+
 /* focus another desktop
  *
- * to avoid flickering
- * first map the new windows
- * first the current window and then all other
- * then unmap the old windows
- * first all others then the current */
+ * every desktop's clients live in its own container window, so no
+ * matter how many windows there are, to avoid flickering
+ * tile the new windows while still unmapped, unless done while idle
+ * first map the new container
+ * then unmap the old container
+ *
+ * the windows tagged with the new desktop are moved into it first, as a
+ * batch, so only the windows that change desktop are touched and the new
+ * desktop keeps its focus */
 void change_desktop(const Arg *arg) {
     if (arg->i == current_desktop) return;
+    if (moving.c) enddrag(False);
+    client *c, *f = desktops[arg->i].current;
+    Bool b = batch;
+    batch = True;
+    for (int i=0; i<views[arg->i].n; i++)
+        if ((c = views[arg->i].c[i])->desktop != arg->i) { sendtodesktop(c, arg->i); c->desktop = arg->i; }
+    if (!(batch = b)) { stale |= touched; touched = 0; }
+    if (f) desktops[arg->i].current = f;
+
     previous_desktop = current_desktop;
     select_desktop(arg->i);
-    if (current) XMapWindow(dis, current->win);
-    for (client *c=head; c; c=c->next) XMapWindow(dis, c->win);
+    if (stale & 1 << arg->i) tile();
+    be->MapWindow(dis, container);
     select_desktop(previous_desktop);
-    for (client *c=head; c; c=c->next) if (c != current) XUnmapWindow(dis, c->win);
-    if (current) XUnmapWindow(dis, current->win);
-    select_desktop(arg->i);
-    tile(); update_current(current);
+    be->UnmapWindow(dis, container);
+    for (c=head; c; c=c->next) selectmask(c, False);
+    select_desktop((visible = arg->i));
+    update_current(current);
     desktopinfo();
 }
 
-/* remove all windows in all desktops by sending a delete message */
+/* remove all windows in all desktops of all screens by sending a delete message
+ * windows that don't go away are given back to the root window
+ * by the save set when the containers are destroyed */
 void cleanup(void) {
     Window root_return, parent_return, *children;
     unsigned int nchildren;
 
-    XUngrabKey(dis, AnyKey, AnyModifier, root);
-    XQueryTree(dis, root, &root_return, &parent_return, &children, &nchildren);
-    for (unsigned int i = 0; i<nchildren; i++) deletewindow(children[i]);
-    if (children) XFree(children);
-    XSync(dis, False);
+    for (int s=0; s<nscreens; s++) {
+        select_screen(s);
+        be->UngrabKey(dis, AnyKey, AnyModifier, root);
+        for (int d=-1; d<DESKTOPS; d++) {
+            if (!be->QueryTree(dis, d < 0 ? root:desktops[d].container, &root_return,
+                            &parent_return, &children, &nchildren)) continue;
+            for (unsigned int i = 0; i<nchildren; i++) deletewindow(children[i]);
+            if (children) XFree(children);
+        }
+    }
+    be->Sync(dis, False);
+    if (shm) shm_unlink(shmname);
 }
 
 /* move a client to another desktop
@@ -258,18 +903,26 @@ void cleanup(void) {
  * and add it as last client of the new desktop's client list */
 void client_to_desktop(const Arg *arg) {
     if (!current || arg->i == current_desktop) return;
+    if (current == moving.c) enddrag(False);
+    settags(current, 0);
     int cd = current_desktop;
     client *p = prev_client(current), *c = current;
+    forget(c, False);
 
     select_desktop(arg->i);
     client *l = prev_client(head);
     update_current(l ? (l->next = c):head ? (head->next = c):(head = c));
+    stale |= 1 << arg->i;
+    unindex(c);
+    c->cells = cells;
+    reindex(c);
+    be->ReparentWindow(dis, c->win, container, c->x, c->y);
+    if (!c->paged) c->unmaps++; /* an unmapped window is not unmapped again */
 
     select_desktop(cd);
     if (c == head || !p) head = c->next; else p->next = c->next;
     c->next = NULL;
-    XUnmapWindow(dis, c->win);
-    update_current(prevfocus);
+    update_current(recent);
 
     if (FOLLOW_WINDOW) change_desktop(arg); else tile();
     desktopinfo();
@@ -284,30 +937,132 @@ void client_to_desktop(const Arg *arg) {
  *   - add/set _NET_WM_STATE_ADD=1,
  *   - toggle _NET_WM_STATE_TOGGLE=2
  *
- * check if window requested fullscreen or activation */
+ * check if window requested fullscreen or activation
+ * the state is always applied, the relayout and focus may be throttled
+ * if the window is on a hidden desktop, that desktop's layout is stale */
 void clientmessage(XEvent *e) {
-    client *t = NULL, *c = wintoclient(e->xclient.window);
+    if (e->xclient.window == root && e->xclient.message_type == cmdatom) { command(e); return; }
+    int d = current_desktop;
+    client *t = NULL, *c = findclient(e->xclient.window, &d);
     if (c && e->xclient.message_type         == netatoms[NET_WM_STATE]
           && ((unsigned)e->xclient.data.l[1] == netatoms[NET_FULLSCREEN]
-           || (unsigned)e->xclient.data.l[2] == netatoms[NET_FULLSCREEN]))
+           || (unsigned)e->xclient.data.l[2] == netatoms[NET_FULLSCREEN])) {
         setfullscreen(c, (e->xclient.data.l[0] == 1 || (e->xclient.data.l[0] == 2 && !c->isfullscrn)));
-    else if (c && e->xclient.message_type == netatoms[NET_ACTIVE]) for (t=head; t && t!=c; t=t->next);
+        if (d != current_desktop) stale |= 1 << d;
+        if (throttle(c, EV_CONFIG)) return;
+    } else if (c && e->xclient.message_type == netatoms[NET_ACTIVE]) {
+        if (throttle(c, EV_ACTIVE)) return;
+        for (t=head; t && t!=c; t=t->next);
+    }
     if (t) update_current(c);
     tile();
 }
 
+/* handle a command sent as a _MONSTERWM_COMMAND client message to the root window
+ * data.l[0] is the command and the rest of data.l its arguments
+ *   CMD_BEGIN                   - open a batch
+ *   CMD_COMMIT                  - commit the open batch
+ *   CMD_DESKTOP window desktop  - move the window to the end of the desktop
+ *   CMD_MODE    desktop mode    - switch the desktop's mode
+ *   CMD_MASTER  desktop pixels  - grow or shrink the desktop's master area
+ *   CMD_SWAP    window          - swap the window with its desktop's master
+ *   CMD_FOCUS   window          - focus the window on its desktop
+ *   CMD_RELOAD                  - reload the configuration, see reload()
+ *   CMD_QUERY   prefix          - list the windows matching the query, see query()
+ *   CMD_JUMP    prefix          - focus the next window matching the query
+ *   CMD_RESTART                 - replace the wm with its binary, see restart()
+ *
+ * inside a batch only the model is updated, outside a batch a command is
+ * committed on its own. a batch that is never committed is committed after
+ * BATCH_TIMEOUT milliseconds, so a dead client can't freeze the wm */
+void command(XEvent *e) {
+    long *l = e->xclient.data.l;
+    int cd = current_desktop, d = 0;
+    Bool implicit = !batch;
+    client *c = NULL;
+
+    if (l[0] == CMD_BEGIN) { if (!batch || burst) batchend = mstime() + BATCH_TIMEOUT; batch = True; burst = False; return; }
+    if (l[0] == CMD_COMMIT) { if (batch) commit(); return; }
+    if (l[0] == CMD_RELOAD) { reload(); return; }
+    if (l[0] == CMD_RESTART) { restart(); return; }
+    if (l[0] == CMD_QUERY || l[0] == CMD_JUMP) { query(l[0] == CMD_JUMP, l[1]); return; }
+
+    batch = True;
+    switch (l[0]) {
+        case CMD_DESKTOP:
+            if ((c = findclient(l[1], &d)) && l[2] >= 0 && l[2] < DESKTOPS && l[2] != d) {
+                settags(c, 0);
+                sendtodesktop(c, l[2]);
+                desktopinfo();
+            }
+            break;
+        case CMD_MODE:
+            if (l[1] < 0 || l[1] >= DESKTOPS || l[2] < 0 || l[2] >= MODES) break;
+            select_desktop(l[1]);
+            switch_mode(&(Arg){.i = l[2]});
+            break;
+        case CMD_MASTER:
+            if (l[1] < 0 || l[1] >= DESKTOPS) break;
+            select_desktop(l[1]);
+            resize_master(&(Arg){.i = l[2]});
+            break;
+        case CMD_SWAP: case CMD_FOCUS:
+            if (!(c = findclient(l[1], &d))) break;
+            select_desktop(d);
+            update_current(c);
+            if (l[0] == CMD_SWAP) swap_master();
+            break;
+    }
+    select_desktop(cd);
+    if (implicit) commit();
+}
+
+/* commit a batch
+ * the current desktop is tiled, restacked and focused once, other affected
+ * desktops are marked stale to be tiled once while idle, and the desktop
+ * info is printed once if anything changed. a batch may touch every screen */
+void commit(void) {
+    int sc = cs;
+    batch = burst = False;
+    for (int s=0; s<nscreens; s++) {
+        select_screen(s);
+        unsigned int t = touched;
+        touched = 0;
+        stale |= t & ~(1 << current_desktop);
+        if (t & 1 << current_desktop) {
+            tile();
+            update_current(current);
+        }
+    }
+    select_screen(sc);
+    if (pendinginfo) desktopinfo();
+}
+
 /* a configure request means that the window requested changes in its geometry
  * state. if the window is fullscreen discard and fill the screen else set the
  * appropriate values as requested, and tile the window again so that it fills
- * the gaps that otherwise could have been created */
+ * the gaps that otherwise could have been created
+ * the request itself is always honored, only the relayout may be throttled
+ * if the window is on a hidden desktop, that desktop's layout is stale */
 void configurerequest(XEvent *e) {
     XConfigureRequestEvent *ev = &e->xconfigurerequest;
-    client *c = wintoclient(ev->window);
-    if (!c || !c->isfullscrn) {
-        XConfigureWindow(dis, ev->window, ev->value_mask, &(XWindowChanges){ev->x,
+    int d = current_desktop;
+    client *c = findclient(ev->window, &d);
+    if (c && d != current_desktop) stale |= 1 << d;
+    if (c && c->isfullscrn) setfullscreen(c, True);
+    else be->ConfigureWindow(dis, ev->window, ev->value_mask, &(XWindowChanges){ev->x,
             ev->y, ev->width, ev->height, ev->border_width, ev->above, ev->detail});
-        XSync(dis, False);
-    } else setfullscreen(c, True);
+    if (c && !c->isfullscrn) {
+        if (ev->value_mask & CWX) c->x = ev->x;
+        if (ev->value_mask & CWY) c->y = ev->y;
+        if (ev->value_mask & CWWidth)  c->w = ev->width;
+        if (ev->value_mask & CWHeight) c->h = ev->height;
+        reindex(c);
+    }
+    if (c && throttle(c, EV_CONFIG)) return;
+    PROBE(xsync__entry, ev->window);
+    be->Sync(dis, False);
+    PROBE(xsync__exit, ev->window);
     tile();
 }
 
@@ -320,40 +1075,120 @@ void deletewindow(Window w) {
     ev.xclient.format = 32;
     ev.xclient.data.l[0] = wmatoms[WM_DELETE_WINDOW];
     ev.xclient.data.l[1] = CurrentTime;
-    XSendEvent(dis, w, False, NoEventMask, &ev);
+    be->SendEvent(dis, w, False, NoEventMask, &ev);
 }
 
 /* output info about the desktops on standard output stream
  *
  * the info is a list of ':' separated values for each desktop
  * desktop to desktop info is separated by ' ' single spaces
+ * desktops are numbered across screens, the selected screen's are printed
  * the info values are
  *   the desktop number/id
  *   the desktop's client count
  *   the desktop's tiling layout mode/id
  *   whether the desktop is the current focused (1) or not (0)
  *   whether any client in that desktop has received an urgent hint
+ * after the last desktop follows a ' ' and the focused window's title
  *
- * once the info is collected, immediately flush the stream */
+ * once the info is collected, immediately flush the stream
+ * inside a batch the output is left for the commit
+ * the line is formatted in scratch memory and written at once */
 void desktopinfo(void) {
+    if ((pendinginfo = batch)) return;
     Bool urgent = False;
     int cd = current_desktop, n=0, d=0;
+    char *line = scratch(DESKTOPS*64 + TITLE_LENGTH), *l = line;
+    strcpy(shown, current ? current->title:"");
     for (client *c; d<DESKTOPS; d++) {
         for (select_desktop(d), c=head, n=0, urgent=False; c; c=c->next, ++n) if (c->isurgent) urgent = True;
-        fprintf(stdout, "%d:%d:%d:%d:%d%c", d, n, mode, current_desktop == cd, urgent, d+1==DESKTOPS?'\n':' ');
+        for (int i=0; i<views[d].n; i++) if ((c = views[d].c[i])->desktop != d) { n++; urgent |= c->isurgent; }
+        l += sprintf(l, "%d:%d:%d:%d:%d ", cs*DESKTOPS + d, n, mode, current_desktop == cd, urgent);
     }
+    sprintf(l - 1, "\t%s\n", shown); /* the title may hold spaces, a tab sets it apart */
+    fputs(line, stdout);
     fflush(stdout);
     if (cd != d-1) select_desktop(cd);
+    dirty = True;
 }
 
 /* a destroy notification is received when a window is being closed
  * on receival, remove the appropriate client that held that window */
 void destroynotify(XEvent *e) {
     client *c = wintoclient(e->xdestroywindow.window);
-    if (c) removeclient(c);
+    if (c) { openburst(); removeclient(c); }
     desktopinfo();
 }
 
+/* unlink the client from its desktop's list and fix that desktop's focus
+ * the client's screen and desktop are left selected and the desktop's number
+ * is returned, or -1 with the lists untouched if the client is on none */
+int detach(client *c) {
+    client **p;
+    XPointer s;
+    int nd = 0;
+    if (!be->FindContext(dis, c->win, screenctx, &s)) select_screen((intptr_t)s);
+    while (nd < DESKTOPS && desktops[nd].cells != c->cells) nd++; /* the grid is the desktop's own */
+    if (nd == DESKTOPS) return -1;
+    select_desktop(nd);
+    for (p = &head; *p && *p != c; p = &(*p)->next);
+    if (!*p) return -1;
+    *p = c->next;
+    unindex(c);
+    if (c == moving.c) enddrag(False);
+    forget(c, False);
+    if (c == current || (head && !head->next)) update_current(recent);
+    return nd;
+}
+
+/* move or resize the dragged window, from its geometry when the drag
+ * started, by the distance the pointer moved since. run() calls this once
+ * the queue is drained, so all the motion queued costs a single resize */
+void dragmove(void) {
+    const XWindowAttributes *wa = &moving.wa;
+    int s = cs;
+    moving.moved = False;
+#ifdef XINPUT2
+    XIButtonState bs; XIModifierState ms; XIGroupState gs; double x, y, d; Window w;
+    if (xiopcode && XIQueryPointer(dis, moving.dev, root, &w, &w, &x, &y, &d, &d, &bs, &ms, &gs)) {
+        free(bs.mask);
+        moving.x = x; moving.y = y;
+    }
+#endif
+    if (s != moving.screen) select_screen(moving.screen);
+    int xw = (moving.how == MOVE ? wa->x:wa->width)  + moving.x - moving.rx;
+    int yh = (moving.how == MOVE ? wa->y:wa->height) + moving.y - moving.ry;
+    if (moving.how == RESIZE) resize(moving.c, wa->x, wa->y,
+       xw>MINWSZ ? xw:wa->width, yh>MINWSZ ? yh:wa->height);
+    else if (moving.how == MOVE) {
+        if (SNAP) snap(moving.c, &xw, &yh);
+        resize(moving.c, xw, yh, wa->width, wa->height);
+    }
+    if (s != cs) select_screen(s);
+}
+
+/* stop the drag, release the pointer and the escape key. if cancelled the
+ * window gets back its geometry and state from before the drag */
+void enddrag(Bool cancel) {
+    client *c = moving.c;
+    int s = cs;
+    if (!c) return;
+    moving.c = NULL; moving.moved = False;
+    if (s != moving.screen) select_screen(moving.screen);
+#ifdef XINPUT2
+    if (xiopcode) xiselect(root, 0); else
+#endif
+    be->UngrabPointer(dis, CurrentTime);
+    grabkeys();
+    if (cancel) {
+        resize(c, moving.wa.x, moving.wa.y, moving.wa.width, moving.wa.height);
+        c->isfloating = moving.floating;
+        if (moving.fullscrn) setfullscreen(c, True);
+        tile();
+    }
+    if (s != cs) select_screen(s);
+}
+
 /* when the mouse enters a window's borders
  * the window, if notifying of such events (EnterWindowMask)
  * will notify the wm and will get focus */
@@ -364,6 +1199,12 @@ void enternotify(XEvent *e) {
           && e->xcrossing.detail != NotifyInferior) update_current(c);
 }
 
+/* focus the nearest window in the given direction */
+void focus_dir(const Arg *arg) {
+    client *c = neighbour(arg->i);
+    if (c) update_current(c);
+}
+
 /* dont give focus to any client except current
  * some apps explicitly call XSetInputFocus suchs
  * as tabbed and chromium, resulting in loss of
@@ -373,6 +1214,56 @@ void focusin(XEvent *e) {
     if (current && current->win != e->xfocus.window) update_current(current);
 }
 
+/* find to which client the given window belongs to, and on which desktop */
+client* findclient(Window w, int *d) {
+    client *c = NULL;
+    int nd = 0, cd = current_desktop;
+    for (Bool found = False; nd<DESKTOPS && !found; ++nd)
+        for (select_desktop(nd), c=head; c && !(found = (w == c->win)); c=c->next);
+    if (cd != nd-1) select_desktop(cd);
+    if (d) *d = nd - 1;
+    return c;
+}
+
+/* apply the trailing update of every throttled event class in a single pass
+ * urgency hints are read again, and the current desktop is tiled and focused
+ * once, no matter how many events were deferred. hidden desktops are tiled
+ * anyway when they are focused, so only their hints matter */
+void flushdeferred(void) {
+    int sc = cs;
+    deferred = False;
+    for (int s=0; s<nscreens; s++) {
+        select_screen(s);
+        client *c, *f = NULL, *cur = current;
+        Bool retile = False, info = False;
+        int cd = current_desktop;
+        for (int d=0; d<DESKTOPS; d++) for (select_desktop(d), c=head; c; c->deferred = 0, c=c->next) {
+            if (c->deferred & 1 << EV_HINTS) { c->isurgent = c != cur && urgenthint(c->win); info = True; }
+            if (d != cd) continue;
+            if (c->deferred & 1 << EV_ACTIVE) f = c;
+            if (c->deferred & ~(1 << EV_HINTS)) retile = True;
+        }
+        select_desktop(cd);
+        if (retile) tile();
+        if (f) update_current(f);
+        if (info) desktopinfo();
+    }
+    select_screen(sc);
+}
+
+/* unlink the client from the selected desktop's focus history, and from
+ * the history of all desktops if all is set */
+void forget(client *c, Bool all) {
+    if (c->newer) c->newer->older = c->older; else if (c == recent) recent = c->older;
+    if (c->older) c->older->newer = c->newer;
+    c->older = c->newer = NULL;
+    if (!all) return;
+    if (c == cycled) cycled = c->gnewer ? c->gnewer:c->golder;
+    if (c->gnewer) c->gnewer->golder = c->golder; else if (c == latest) latest = c->golder;
+    if (c->golder) c->golder->gnewer = c->gnewer;
+    c->golder = c->gnewer = NULL;
+}
+
 /* find and focus the client which received
  * the urgent hint in the current desktop */
 void focusurgent(void) {
@@ -388,30 +1279,55 @@ void focusurgent(void) {
 /* get a pixel with the requested color
  * to fill some window area - borders */
 unsigned long getcolor(const char* color) {
-    XColor c; Colormap map = DefaultColormap(dis, screen);
-    if (!XAllocNamedColor(dis, map, color, &c, &c)) err(EXIT_FAILURE, "cannot allocate color");
+    XColor c; Colormap map = be->DefaultColormap(dis, screen);
+    if (!be->AllocNamedColor(dis, map, color, &c, &c)) err(EXIT_FAILURE, "cannot allocate color");
     return c.pixel;
 }
 
+/* read the window's title, preferring _NET_WM_NAME over WM_NAME, into its
+ * bounded buffer, cut at a whole character and with newlines as spaces
+ * so that it fits a line, and return whether it changed */
+Bool gettitle(client *c) {
+    XTextProperty tp = { NULL, None, 0, 0 };
+    char t[TITLE_LENGTH] = "", **list = NULL;
+    int n = 0;
+    c->newtitle = False;
+    if (!be->GetTextProperty(dis, c->win, &tp, netatoms[NET_WM_NAME]) || !tp.nitems) {
+        if (tp.value) XFree(tp.value);
+        if (!be->GetTextProperty(dis, c->win, &tp, XA_WM_NAME)) tp.value = NULL;
+    }
+    if (tp.value && Xutf8TextPropertyToTextList(dis, &tp, &list, &n) >= Success && n > 0 && *list) {
+        size_t i = strlen(strncpy(t, *list, TITLE_LENGTH - 1));
+        if (i == TITLE_LENGTH - 1) { while (i && (t[i-1] & 0xC0) == 0x80) i--; if (i && t[i-1] & 0x80) i--; t[i] = 0; }
+        for (char *p = t; (p = strchr(p, '\n')); ) *p = ' ';
+    }
+    if (list) XFreeStringList(list);
+    if (tp.value) XFree(tp.value);
+    if (!strcmp(t, c->title)) return False;
+    memcpy(c->title, t, TITLE_LENGTH);
+    rekey(c);
+    return True;
+}
+
 /* set the given client to listen to button events (presses / releases) */
 void grabbuttons(client *c) {
     unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
-    for (unsigned int b=0; b<LENGTH(buttons); b++)
+    for (unsigned int b=0; b<cfg->nbuttons; b++)
         for (unsigned int m=0; m<LENGTH(modifiers); m++)
-            XGrabButton(dis, buttons[b].button, buttons[b].mask|modifiers[m], c->win,
+            be->GrabButton(dis, cfg->buttons[b].button, cfg->buttons[b].mask|modifiers[m], c->win,
                         False, BUTTONMASK, GrabModeAsync, GrabModeAsync, None, None);
 }
 
 /* the wm should listen to key presses */
 void grabkeys(void) {
     KeyCode code;
-    XUngrabKey(dis, AnyKey, AnyModifier, root);
+    be->UngrabKey(dis, AnyKey, AnyModifier, root);
 
     unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
-    for (unsigned int k=0; k<LENGTH(keys); k++)
-        if ((code = XKeysymToKeycode(dis, keys[k].keysym)))
+    for (unsigned int k=0; k<cfg->nkeys; k++)
+        if ((code = be->KeysymToKeycode(dis, cfg->keys[k].keysym)))
             for (unsigned int m=0; m<LENGTH(modifiers); m++)
-                XGrabKey(dis, code, keys[k].mod|modifiers[m], root, True, GrabModeAsync, GrabModeAsync);
+                be->GrabKey(dis, code, cfg->keys[k].mod|modifiers[m], root, True, GrabModeAsync, GrabModeAsync);
 }
 
 /* arrange windows in a grid */
@@ -421,21 +1337,61 @@ void grid(int hh, int cy) {
     for (cols=0; cols <= n/2; cols++) if (cols*cols >= n) break; /* emulate square root */
     if (n == 0) return; else if (n == 5) cols = 2;
 
-    int rows = n/cols, ch = hh - BORDER_WIDTH, cw = (ww - BORDER_WIDTH)/(cols?cols:1);
+    int rows = n/cols, ch = hh - cfg->borderwidth, cw = (ww - cfg->borderwidth)/(cols?cols:1);
     for (client *c=head; c; c=c->next) {
         if (ISFFT(c)) continue; else ++i;
         if (i/rows + 1 > cols - n%cols) rows = n/cols + 1;
-        XMVRSZ(dis, c->win, cn*cw, cy + rn*ch/rows, cw - BORDER_WIDTH, ch/rows - BORDER_WIDTH);
+        resize(c, cn*cw, cy + rn*ch/rows, cw - cfg->borderwidth, ch/rows - cfg->borderwidth);
         if (++rn >= rows) { rn = 0; cn++; }
     }
 }
 
-/* on the press of a key check to see if there's a binded function to call */
+/* focus the next window after the focused one whose class, instance or
+ * title contains the text in arg->v, ignoring case, wherever it is */
+void jump(const Arg *arg) {
+    client *c = arg->v ? search(lowered(arg->v), False, current):NULL;
+    if (c) jumpto(c);
+}
+
+/* focus the window on whichever screen and desktop it is */
+void jumpto(client *c) {
+    XPointer p;
+    int d;
+    if (!be->FindContext(dis, c->win, screenctx, &p)) select_screen((intptr_t)p);
+    if (!findclient(c->win, &d)) return;
+    change_desktop(&(Arg){.i = d});
+    update_current(c);
+}
+
+/* on the press of a key check to see if there's a binded function to call
+ * with more than one screen, the function acts on the screen under the pointer,
+ * whose root the event carries.
+ * only the first binding that matches is called, as it may reload them */
 void keypress(XEvent *e) {
     KeySym keysym = XkbKeycodeToKeysym(dis, e->xkey.keycode, 0, 0);
-    for (unsigned int i=0; i<LENGTH(keys); i++)
-        if (keysym == keys[i].keysym && CLEANMASK(keys[i].mod) == CLEANMASK(e->xkey.state)
-                   && keys[i].func) keys[i].func(&keys[i].arg);
+    void (*f)(const Arg *);
+    XPointer p;
+    if (moving.c && keysym == XK_Escape) { enddrag(True); return; }
+    if (nscreens > 1 && !be->FindContext(dis, e->xkey.root, screenctx, &p)) select_screen((intptr_t)p);
+    for (unsigned int i=0; i<cfg->nkeys; i++)
+        if (keysym == cfg->keys[i].keysym && CLEANMASK(cfg->keys[i].mod) == CLEANMASK(e->xkey.state)
+                   && (f = cfg->keys[i].func)) {
+            inputtime = e->xkey.time;
+            f(&cfg->keys[i].arg);
+            stamp(f, e->xkey.time);
+            return;
+        }
+}
+
+/* on the release of a modifier key while cycling through the recently
+ * used windows, give the keyboard back and make the window cycled to the
+ * most recent one */
+void keyrelease(XEvent *e) {
+    if (!cycling || !IsModifierKey(XkbKeycodeToKeysym(dis, e->xkey.keycode, 0, 0))) return;
+    be->UngrabKeyboard(dis, CurrentTime);
+    cycling = False;
+    if (cycled) promote(cycled);
+    cycled = NULL;
 }
 
 /* explicitly kill a client - close the highlighted window
@@ -443,109 +1399,244 @@ void keypress(XEvent *e) {
 void killclient(void) {
     if (!current) return;
     Atom *prot; int n = -1;
-    if (XGetWMProtocols(dis, current->win, &prot, &n)) while(!--n<0 && prot[n] != wmatoms[WM_DELETE_WINDOW]);
-    if (n < 0) XKillClient(dis, current->win); else deletewindow(current->win);
+    if (be->GetWMProtocols(dis, current->win, &prot, &n)) while(!--n<0 && prot[n] != wmatoms[WM_DELETE_WINDOW]);
+    if (n < 0) be->KillClient(dis, current->win); else deletewindow(current->win);
     removeclient(current);
 }
 
+/* match the window to the launch it comes from, by the startup id the
+ * command passed on to it, or else by its process. the launch's latency
+ * is recorded, and the desktop it was launched from is returned, or -1 if
+ * there is no such launch or it was on another screen. launches older
+ * than LAUNCH_TIMEOUT seconds are given up on */
+int launchdesktop(Window w) {
+    XTextProperty tp = { NULL, None, 0, 0 };
+    unsigned char *pid = NULL; unsigned long n, after; int format; Atom type;
+    launch *l = NULL;
+    long now = ustime();
+    if (!nlaunches) return -1;
+    for (int i=0; i<LAUNCHES; i++) if (launches[i].id[0] && now - launches[i].time > LAUNCH_TIMEOUT*1000000L) {
+        launchstat *st = launchstatfor(launches[i].cmd);
+        if (st) st->expired++;
+        launches[i].id[0] = '\0'; nlaunches--;
+    }
+    if (be->GetTextProperty(dis, w, &tp, startupatom) && tp.value)
+        for (int i=0; i<LAUNCHES && !l; i++)
+            if (launches[i].id[0] && !strcmp((char *)tp.value, launches[i].id)) l = &launches[i];
+    if (!l && be->GetWindowProperty(dis, w, pidatom, 0L, 1L, False, XA_CARDINAL,
+                &type, &format, &n, &after, &pid) == Success && pid && n)
+        for (int i=0; i<LAUNCHES && !l; i++)
+            if (launches[i].id[0] && launches[i].pid == *(long *)pid) l = &launches[i];
+    if (tp.value) XFree(tp.value);
+    if (pid) XFree(pid);
+    if (!l) return -1;
+    launchstat *st = launchstatfor(l->cmd);
+    if (st) record(&st->latency, now - l->time);
+    l->id[0] = '\0'; nlaunches--;
+    return l->screen == cs ? l->desktop:-1;
+}
+
+/* the launch latencies of the command, NULL if LAUNCHES commands are tracked */
+launchstat* launchstatfor(const char *cmd) {
+    for (int i=0; i<LAUNCHES; i++) if (!launchstats[i].cmd[0] || !strcmp(launchstats[i].cmd, cmd)) {
+        if (!launchstats[i].cmd[0]) snprintf(launchstats[i].cmd, sizeof launchstats[i].cmd, "%s", cmd);
+        return &launchstats[i];
+    }
+    return NULL;
+}
+
+/* a lower case copy of the string, in scratch memory */
+char* lowered(const char *s) {
+    char *l = scratch(strlen(s) + 1), *p = l;
+    while ((*p++ = tolower((unsigned char)*s++)));
+    return l;
+}
+
 /* focus the previously focused desktop */
 void last_desktop(void) {
     change_desktop(&(Arg){.i = previous_desktop});
 }
 
+/* load the configuration module at path
+ * the module is checked to be built for this wm, with rules and colors that
+ * can be applied, then its config and tables are copied in one block, with
+ * its stand-ins mapped back to the functions they stand for.
+ * the module stays loaded for the arguments and strings the copy points to */
+const config* loadconfig(const char *path) {
+    void *handle = openmodule(path);
+    const config *m = handle ? dlsym(handle, "monsterwm_config"):NULL;
+    Colormap map = be->DefaultColormap(dis, screen);
+    Bool valid = m != NULL;
+    const char *e;
+    XColor x;
+
+    if (!valid) { if ((e = dlerror())) warnx("cannot load configuration: %s", e); }
+    else if (!(valid = m->abi == CONFIG_ABI && m->nbindings == LENGTH(bindings)))
+        warnx("%s: built for another version of monsterwm", path);
+    else if (!(valid = be->ParseColor(dis, map, m->focus, &x) && be->ParseColor(dis, map, m->unfocus, &x)))
+        warnx("%s: invalid border color", path);
+    else for (unsigned int i=0; i<m->nrules && valid; i++)
+        if (!(valid = m->rules[i].desktop < DESKTOPS)) warnx("%s: rule for %s: no such desktop", path, m->rules[i].class);
+    if (!valid) { if (handle) dlclose(handle); return NULL; }
+
+    config *c = malloc(sizeof(config) + m->nkeys*sizeof(key) + m->nbuttons*sizeof(Button));
+    if (!c) err(EXIT_FAILURE, "cannot allocate configuration");
+    memcpy(c, m, sizeof(config));
+    c->keys = memcpy(c + 1, m->keys, m->nkeys*sizeof(key));
+    c->buttons = memcpy(c->keys + m->nkeys, m->buttons, m->nbuttons*sizeof(Button));
+    for (unsigned int i=0, j=0; i<c->nkeys; i++, j=0) {
+        while (j<LENGTH(bindings) && m->bindings[j] != c->keys[i].func) j++;
+        c->keys[i].func = j<LENGTH(bindings) ? bindings[j]:NULL;
+    }
+    for (unsigned int i=0, j=0; i<c->nbuttons; i++, j=0) {
+        while (j<LENGTH(bindings) && m->bindings[j] != c->buttons[i].func) j++;
+        c->buttons[i].func = j<LENGTH(bindings) ? bindings[j]:NULL;
+    }
+    c->bindings = bindings;
+    module = handle;
+    return c;
+}
+
+/* open a private copy of the module at path, next to it, and unlink it once
+ * loaded. the loader knows a module by its path and file, and a module built
+ * again is written over in place, so the copy is what lets it be read anew
+ * while the module it replaces is still loaded */
+void* openmodule(const char *path) {
+    char name[PATH_MAX], buf[BUFSIZ];
+    void *handle = NULL;
+    ssize_t n = 0;
+    int in = open(path, O_RDONLY|O_CLOEXEC), out = -1;
+    if (in < 0 || snprintf(name, sizeof name, "%s.XXXXXX", path) >= (int)sizeof name || (out = mkstemp(name)) < 0) {
+        warn("cannot copy configuration %s", path);
+        if (in >= 0) close(in);
+        return NULL;
+    }
+    while ((n = read(in, buf, sizeof buf)) > 0 && write(out, buf, n) == n);
+    if (n) warn("cannot copy configuration %s", path);
+    else handle = dlopen(name, RTLD_NOW|RTLD_LOCAL);
+    unlink(name);
+    close(in); close(out);
+    return handle;
+}
+
+/* whether the lower case query is found in the search key, only at the
+ * start of the class, instance or title if prefix */
+Bool matches(const char *key, const char *q, Bool prefix) {
+    for (const char *p = key; (p = strstr(p, q)); p++) if (!prefix || p == key || p[-1] == '\n') return True;
+    return False;
+}
+
 /* a map request is received when a window wants to display itself
  * if the window has override_redirect flag set then it should not be handled
  * by the wm. if the window already has a client then there is nothing to do.
  *
+ * a window of a command launched by spawn() goes to the desktop it was
+ * launched from, else to the current one, unless an app rule names another.
  * get the window class and name instance and try to match against an app rule.
  * create a client for the window, that client will always be current.
  * check for transient state, and fullscreen state and the appropriate values.
  * if the desktop in which the window was spawned is the current desktop then
- * display the window, else, if set, focus the new desktop. */
+ * display the window, else, if set, focus the new desktop.
+ *
+ * the window is reparented into its desktop's container and mapped there,
+ * it is added to the save set, so it survives if the wm goes away */
 void maprequest(XEvent *e) {
     static XWindowAttributes wa; Window w;
-    if (XGetWindowAttributes(dis, e->xmaprequest.window, &wa) && wa.override_redirect) return;
+    if (be->GetWindowAttributes(dis, e->xmaprequest.window, &wa) && wa.override_redirect) return;
     if (wintoclient(e->xmaprequest.window)) return;
 
     Bool follow = False, floating = False;
-    int cd = current_desktop, newdsk = current_desktop;
+    int cd = current_desktop, newdsk = launchdesktop(e->xmaprequest.window);
+    if (newdsk < 0) newdsk = current_desktop;
     XClassHint ch = {0, 0};
-    if (XGetClassHint(dis, e->xmaprequest.window, &ch))
-        for (unsigned int i=0; i<LENGTH(rules); i++)
-            if (strstr(ch.res_class, rules[i].class) || strstr(ch.res_name, rules[i].class)) {
-                follow = rules[i].follow;
-                newdsk = (rules[i].desktop < 0) ? current_desktop:rules[i].desktop;
-                floating = rules[i].floating;
+    if (be->GetClassHint(dis, e->xmaprequest.window, &ch))
+        for (unsigned int i=0; i<cfg->nrules; i++)
+            if (strstr(ch.res_class, cfg->rules[i].class) || strstr(ch.res_name, cfg->rules[i].class)) {
+                follow = cfg->rules[i].follow;
+                newdsk = (cfg->rules[i].desktop < 0) ? newdsk:cfg->rules[i].desktop;
+                floating = cfg->rules[i].floating;
                 break;
             }
-    if (ch.res_class) XFree(ch.res_class);
-    if (ch.res_name) XFree(ch.res_name);
 
     if (cd != newdsk) select_desktop(newdsk);
     client *c = addwindow(e->xmaprequest.window);
-    c->istransient = XGetTransientForHint(dis, c->win, &w);
+    snprintf(c->class, NAME_LENGTH, "%s", ch.res_class ? ch.res_class:"");
+    snprintf(c->instance, NAME_LENGTH, "%s", ch.res_name ? ch.res_name:"");
+    if (ch.res_class) XFree(ch.res_class);
+    if (ch.res_name) XFree(ch.res_name);
+    c->x = wa.x; c->y = wa.y; c->w = wa.width; c->h = wa.height;
+    be->AddToSaveSet(dis, c->win);
+    be->ReparentWindow(dis, c->win, container, c->x, c->y);
+    c->istransient = be->GetTransientForHint(dis, c->win, &w);
+    if (!gettitle(c)) rekey(c);
     c->isfloating = floating || c->istransient;
-
-    int di; unsigned long dl; unsigned char *state = NULL; Atom da;
-    if (XGetWindowProperty(dis, c->win, netatoms[NET_WM_STATE], 0L, sizeof da,
-              False, XA_ATOM, &da, &di, &dl, &dl, &state) == Success && state)
+    XSizeHints hints; long supplied;
+    if (ISFLT(c) && !c->istransient && !(be->GetWMNormalHints(dis, c->win, &hints, &supplied)
+                                        && hints.flags & USPosition)) place(c);
+    else reindex(c);
+
+    int di; unsigned long dn, dl; unsigned char *state = NULL; Atom da;
+    if (be->GetWindowProperty(dis, c->win, netatoms[NET_WM_STATE], 0L, sizeof da,
+              False, XA_ATOM, &da, &di, &dn, &dl, &state) == Success && state && dn)
         setfullscreen(c, (*(Atom *)state == netatoms[NET_FULLSCREEN]));
     if (state) XFree(state);
 
-    if (cd != newdsk) select_desktop(cd);
-    if (cd == newdsk) { tile(); XMapWindow(dis, c->win); update_current(c); }
+    if (cd != newdsk) { select_desktop(cd); stale |= 1 << newdsk; }
+    if (cd == newdsk) tile();
+    be->MapWindow(dis, c->win);
+    if (cd == newdsk) update_current(c);
     else if (follow) { change_desktop(&(Arg){.i = newdsk}); update_current(c); }
     grabbuttons(c);
 
     desktopinfo();
 }
 
-/* grab the pointer and get it's current position
- * all pointer movement events will be reported until it's ungrabbed
- * until the mouse button has not been released,
- * grab the interesting events - button press/release and pointer motion
- * and on on pointer movement resize or move the window under the curson.
- * if the received event is a map request or a configure request call the
- * appropriate handler, and stop listening for other events.
- * Ungrab the poitner and event handling is passed back to run() function.
+/* monotonic time in milliseconds */
+long mstime(void) {
+    return ustime() / 1000;
+}
+
+/* grab the pointer and get it's current position, and start moving or
+ * resizing the current window. the drag is carried on by the pointer's
+ * motion and button release events as run() dispatches them, so the other
+ * events are handled all along. escape cancels the drag, another binding
+ * pressed meanwhile starts over from where the window is.
  * Once a window has been moved or resized, it's marked as floating. */
 void mousemotion(const Arg *arg) {
     if (!current) return;
-    static XWindowAttributes wa;
-    if (!XGetWindowAttributes(dis, current->win, &wa)) return;
-
-    if (XGrabPointer(dis, root, False, BUTTONMASK|PointerMotionMask, GrabModeAsync,
-                     GrabModeAsync, None, None, CurrentTime) != GrabSuccess) return;
-    if (arg->i == RESIZE) XWarpPointer(dis, None, current->win, 0, 0, 0, 0, wa.width, wa.height);
-    int rx, ry, c, xw, yh; unsigned int m; Window w;
-    XQueryPointer(dis, root, &w, &w, &rx, &ry, &c, &c, &m);
+    if (moving.c) enddrag(False);
+    if (!be->GetWindowAttributes(dis, current->win, &moving.wa)) return;
+    if (!xiopcode) {
+        if (be->GrabPointer(dis, root, False, BUTTONMASK|PointerMotionMask, GrabModeAsync,
+                         GrabModeAsync, None, None, CurrentTime) != GrabSuccess) return;
+        if (arg->i == RESIZE) be->WarpPointer(dis, None, current->win, 0, 0, 0, 0, moving.wa.width, moving.wa.height);
+        int c; unsigned int m; Window w;
+        be->QueryPointer(dis, root, &w, &w, &moving.rx, &moving.ry, &c, &c, &m);
+    }
+#ifdef XINPUT2
+    else if (!xidragstart(arg->i)) return;
+#endif
+    be->GrabKey(dis, be->KeysymToKeycode(dis, XK_Escape), AnyModifier, root, True, GrabModeAsync, GrabModeAsync);
+    moving.c = current; moving.how = arg->i; moving.screen = cs; moving.moved = False;
+    moving.x = moving.rx; moving.y = moving.ry;
+    moving.floating = current->isfloating; moving.fullscrn = current->isfullscrn;
 
     if (current->isfullscrn) setfullscreen(current, False);
     if (!current->isfloating) current->isfloating = True;
     tile(); update_current(current);
+}
 
-    XEvent ev;
-    do {
-        XMaskEvent(dis, BUTTONMASK|PointerMotionMask|SubstructureRedirectMask, &ev);
-        switch (ev.type) {
-            case ConfigureRequest: case MapRequest:
-                events[ev.type](&ev);
-                break;
-            case MotionNotify:
-                xw = (arg->i == MOVE ? wa.x:wa.width)  + ev.xmotion.x - rx;
-                yh = (arg->i == MOVE ? wa.y:wa.height) + ev.xmotion.y - ry;
-                if (arg->i == RESIZE) XResizeWindow(dis, current->win,
-                   xw>MINWSZ ? xw:wa.width, yh>MINWSZ ? yh:wa.height);
-                else if (arg->i == MOVE) XMoveWindow(dis, current->win, xw, yh);
-                break;
-        }
-    } while(ev.type != ButtonRelease);
-    XUngrabPointer(dis, CurrentTime);
+/* the pointer moved while dragging, the window follows once run() has
+ * drained the queue */
+void motionnotify(XEvent *e) {
+    if (!moving.c) return;
+    moving.x = e->xmotion.x_root; moving.y = e->xmotion.y_root;
+    moving.moved = True;
 }
 
 /* each window should cover all the available screen space */
 void monocle(int hh, int cy) {
-    for (client *c=head; c; c=c->next) if (!ISFFT(c)) XMVRSZ(dis, c->win, 0, cy, ww, hh);
+    for (client *c=head; c; c=c->next) if (!ISFFT(c)) resize(c, 0, cy, ww, hh);
 }
 
 /* move the current client, to current->next
@@ -627,12 +1718,57 @@ void move_up(void) {
 /* move and resize a window with the keyboard */
 void moveresize(const Arg *arg) {
     XWindowAttributes wa;
-    if (!current || !XGetWindowAttributes(dis, current->win, &wa)) return;
+    if (!current || !be->GetWindowAttributes(dis, current->win, &wa)) return;
     if (!current->isfloating) { current->isfloating = True; tile(); }
-    XMVRSZ(dis, current->win, wa.x + ((int *)arg->v)[0], wa.y + ((int *)arg->v)[1],
+    resize(current, wa.x + ((int *)arg->v)[0], wa.y + ((int *)arg->v)[1],
                     wa.width  + ((int *)arg->v)[2], wa.height + ((int *)arg->v)[3]);
 }
 
+/* collect the clients indexed in the grid cells covering the given area
+ * each client is collected once, in the nearbyfound array, and their number is returned */
+int nearby(int x, int y, int w, int h) {
+    int sh = wh + PANEL_HEIGHT, n = 0;
+    marks++;
+    for (int i=CELL(x, ww); i<=CELL(x + w, ww); i++) for (int j=CELL(y, sh); j<=CELL(y + h, sh); j++)
+        for (int k=0; k<cells[j*GRID_CELLS + i].n; k++) {
+            client *c = cells[j*GRID_CELLS + i].c[k];
+            if (c->mark == marks) continue;
+            if (n >= (int)nfound && !(nearbyfound = realloc(nearbyfound, (nfound = 2*nfound + 16)*sizeof(client *))))
+                err(EXIT_FAILURE, "cannot allocate grid query");
+            (nearbyfound[n++] = c)->mark = marks;
+        }
+    return n;
+}
+
+/* find the nearest window in the given direction from the current one
+ *
+ * the grid is searched in bands of cells, outwards from the current
+ * window's center. a window's distance is how far its center lies in
+ * that direction, plus twice its offset across it. the search stops
+ * once no window in the bands left can be closer than the best found */
+client* neighbour(int dir) {
+    if (!current) return NULL;
+    Bool vert = dir == UP || dir == DOWN;
+    int sign = (dir == RIGHT || dir == DOWN) ? 1:-1, size = vert ? wh + PANEL_HEIGHT:ww;
+    int along = vert ? current->y + current->h/2:current->x + current->w/2;
+    int across = vert ? current->x + current->w/2:current->y + current->h/2;
+    client *best = NULL; long bd = -1;
+
+    for (int k=CELL(along, size); k>=0 && k<GRID_CELLS; k+=sign) {
+        int lo = k*size/GRID_CELLS, hi = (k + 1)*size/GRID_CELLS - 1;
+        if (bd >= 0 && (sign > 0 ? lo - along:along - hi) > bd) break;
+        int n = vert ? nearby(0, lo, ww - 1, hi - lo):nearby(lo, 0, hi - lo, wh + PANEL_HEIGHT - 1);
+        for (int i=0; i<n; i++) {
+            client *c = nearbyfound[i];
+            long a = vert ? c->y + c->h/2:c->x + c->w/2, o = vert ? c->x + c->w/2:c->y + c->h/2;
+            if (c == current || c->isfullscrn || (a - along)*sign <= 0) continue;
+            long d = (a - along)*sign + 2*labs(o - across);
+            if (bd < 0 || d < bd) { bd = d; best = c; }
+        }
+    }
+    return best;
+}
+
 /* cyclic focus the next window
  * if the window is the last on stack, focus head */
 void next_win(void) {
@@ -640,6 +1776,44 @@ void next_win(void) {
     update_current(current->next ? current->next:head);
 }
 
+/* open a batch for a burst of windows going away, when none is open, so
+ * that an application closing many windows costs one layout, focus and
+ * desktop info update. run() commits it once the server has no more events
+ * to send, or after BURST_TIMEOUT milliseconds if they keep coming */
+void openburst(void) {
+    if (batch) return;
+    batch = burst = True;
+    batchend = mstime() + BURST_TIMEOUT;
+}
+
+/* the area the client would overlap with other floating windows at the given position */
+long overlap(client *c, int x, int y) {
+    long area = 0;
+    for (int i=0, n=nearby(x, y, c->w, c->h); i<n; i++) {
+        client *t = nearbyfound[i];
+        if (t == c || !ISFLT(t)) continue;
+        long w = (x + c->w < t->x + t->w ? x + c->w:t->x + t->w) - (x > t->x ? x:t->x);
+        long h = (y + c->h < t->y + t->h ? y + c->h:t->y + t->h) - (y > t->y ? y:t->y);
+        if (w > 0 && h > 0) area += w*h;
+    }
+    return area;
+}
+
+/* place a new floating window where it overlaps the least with the other
+ * floating windows. the requested position is tried first and then the
+ * corner of every grid cell, so only the windows around each candidate
+ * position are looked at */
+void place(client *c) {
+    int x = c->x, y = c->y, cy = TOP_PANEL && showpanel ? PANEL_HEIGHT:0, hh = wh + (showpanel ? 0:PANEL_HEIGHT);
+    long best = overlap(c, x, y), o;
+    for (int i=0; best && i<GRID_CELLS*GRID_CELLS; i++) {
+        int px = i%GRID_CELLS*ww/GRID_CELLS, py = cy + i/GRID_CELLS*hh/GRID_CELLS;
+        if (px + c->w > ww || py + c->h > cy + hh) continue;
+        if ((o = overlap(c, px, py)) < best) { best = o; x = px; y = py; }
+    }
+    resize(c, x, y, c->w, c->h);
+}
+
 /* get the previous client from the given
  * if no such client, return NULL */
 client* prev_client(client *c) {
@@ -648,24 +1822,115 @@ client* prev_client(client *c) {
     return p;
 }
 
+/* tile one hidden desktop of any screen whose layout is stale, while its
+ * windows are unmapped. clients resize and repaint off screen, and switching
+ * to the desktop later only has to map them. returns whether there was one */
+Bool prelayout(void) {
+    int sc = cs, cd, d = 0;
+    for (int s=0; !stale && s<nscreens; s++) if (s != cs && screens[s].stale) select_screen(s);
+    Bool found = stale != 0;
+    if (found) {
+        cd = current_desktop;
+        while (!(stale & 1 << d)) d++;
+        select_desktop(d);
+        tile();
+        select_desktop(cd);
+    }
+    select_screen(sc);
+    return found;
+}
+
 /* cyclic focus the previous window
  * if the window is the head, focus the last stack window */
 void prev_win(void) {
     if (!current || !head->next) return;
-    update_current(prev_client(prevfocus = current));
+    update_current(prev_client(current));
+}
+
+/* move the client to the front of the focus history of all desktops */
+void promote(client *c) {
+    if (c == latest) return;
+    if (c->gnewer) c->gnewer->golder = c->golder;
+    if (c->golder) c->golder->gnewer = c->gnewer;
+    c->gnewer = NULL;
+    if ((c->golder = latest)) latest->gnewer = c;
+    latest = c;
+}
+
+/* the upper bound in microseconds under which p percent of the samples fall */
+long percentile(histogram *h, int p) {
+    unsigned long seen = 0; int i = 0;
+    if (!h->n) return 0;
+    while (i < 31 && (seen += h->bucket[i]) * 100 < h->n * p) i++;
+    return 1L << i;
 }
 
 /* property notify is called when one of the window's properties
- * is changed, such as an urgent hint is received */
+ * is changed, such as an urgent hint is received
+ * windows toggling their hints too fast get a single trailing update */
 void propertynotify(XEvent *e) {
+    if (e->xproperty.window == root) {
+        if (e->xproperty.atom != stampatom || !nstamps) return;
+        inputstamp *s = &stamps[firststamp];
+        firststamp = (firststamp + 1) % STAMPS;
+        record(&inputlatency[s->fn], ((e->xproperty.time - s->time) & 0xffffffff) * 1000);
+        if (--nstamps) return;
+        for (int i=0; i<nscreens; i++) if (stamping & 1 << i) be->SelectInput(dis, screens[i].root, ROOTMASK);
+        stamping = 0;
+        return;
+    }
     client *c = wintoclient(e->xproperty.window);
-    if (!c || e->xproperty.atom != XA_WM_HINTS) return;
-    XWMHints *wmh = XGetWMHints(dis, c->win);
-    c->isurgent = c != current && wmh && (wmh->flags & XUrgencyHint);
-    XFree(wmh);
+    if (c && (e->xproperty.atom == XA_WM_NAME || e->xproperty.atom == netatoms[NET_WM_NAME])) {
+        c->newtitle = True;
+        if (c != current && !titledue) titledue = mstime() + TITLE_INTERVAL;
+        return;
+    }
+    if (!c || e->xproperty.atom != XA_WM_HINTS || throttle(c, EV_HINTS)) return;
+    c->isurgent = c != current && urgenthint(c->win);
     desktopinfo();
 }
 
+/* publish the desktop state to shared memory under the sequence lock
+ * the snapshot is written in place, readers never block the wm */
+void publish(void) {
+    published = mstime();
+    if (!shm) return;
+    shmdesktop *sd = (shmdesktop *)(shm + 1);
+    shmclient *sc = (shmclient *)(sd + nscreens*DESKTOPS);
+    int s0 = cs, n = 0;
+
+    dirty = False;
+    shm->seq++;
+    __sync_synchronize();
+    shm->desktop = cs*DESKTOPS + current_desktop;
+    shm->focus = current ? current->win:0;
+    for (int s=0; s<nscreens; s++) {
+        select_screen(s);
+        int cd = current_desktop;
+        for (int d=0, i=s*DESKTOPS; d<DESKTOPS; d++, i++) {
+            select_desktop(d);
+            sd[i] = (shmdesktop){ 0, mode, False, showpanel };
+            for (client *c=head; c; c=c->next, sd[i].clients++) {
+                if (c->isurgent) sd[i].urgent = True;
+                if (n >= SHM_CLIENTS) continue;
+                sc[n] = (shmclient){ c->win, i, (c->isurgent ? SHM_URGENT:0)
+                        | (c->istransient ? SHM_TRANSIENT:0) | (c->isfullscrn ? SHM_FULLSCRN:0)
+                        | (c->isfloating ? SHM_FLOATING:0), c->tags, c->x, c->y, c->w, c->h, "" };
+                memcpy(sc[n++].title, c->title, TITLE_LENGTH);
+            }
+            for (int k=0; k<views[d].n; k++) if (views[d].c[k]->desktop != d) {
+                sd[i].clients++;
+                if (views[d].c[k]->isurgent) sd[i].urgent = True;
+            }
+        }
+        select_desktop(cd);
+    }
+    shm->nclients = n;
+    __sync_synchronize();
+    shm->seq++;
+    select_screen(s0);
+}
+
 /* to quit just stop receiving and processing events
  * run() is stopped and control is back to main() */
 void quit(const Arg *arg) {
@@ -673,29 +1938,192 @@ void quit(const Arg *arg) {
     running = False;
 }
 
+/* add a sample to the histogram - bucket i holds [2^(i-1), 2^i) microseconds */
+void record(histogram *h, long us) {
+    int i = 0;
+    while (i < 31 && us >> i > 0) i++;
+    h->bucket[i]++; h->n++;
+    if ((unsigned long)us > h->max) h->max = us;
+}
+
+/* focus the window used before the current one, on whichever screen and
+ * desktop it is. the keyboard is grabbed until the binding's modifier is
+ * released, each press meanwhile going one window further back in the
+ * history, or forward with a negative argument, and the history is only
+ * reordered once the modifier is released */
+void recent_win(const Arg *arg) {
+    if (!latest || !latest->golder) return;
+    if (!cycling && be->GrabKeyboard(dis, root, True, GrabModeAsync, GrabModeAsync, CurrentTime) == GrabSuccess) {
+        cycling = True;
+        cycled = latest;
+    }
+    client *c = cycled ? cycled:latest;
+    if (arg->i < 0) c = c->gnewer ? c->gnewer:c;
+    else c = c->golder ? c->golder:latest;
+    if (cycling) cycled = c;
+    jumpto(c);
+}
+
+/* index the client in the grid cells its geometry overlaps */
+void reindex(client *c) {
+    int sh = wh + PANEL_HEIGHT;
+    unindex(c);
+    c->gx = CELL(c->x, ww); c->gw = CELL(c->x + c->w, ww) - c->gx + 1;
+    c->gy = CELL(c->y, sh); c->gh = CELL(c->y + c->h, sh) - c->gy + 1;
+    for (int i=c->gx; i<c->gx + c->gw; i++) for (int j=c->gy; j<c->gy + c->gh; j++) {
+        cell *l = &c->cells[j*GRID_CELLS + i];
+        if (l->n == l->size && !(l->c = realloc(l->c, (l->size = 2*l->size + 4)*sizeof(client *))))
+            err(EXIT_FAILURE, "cannot allocate grid cell");
+        l->c[l->n++] = c;
+    }
+}
+
+/* answer a query command, the query being the _MONSTERWM_QUERY property
+ * of the root window. either every matching window is listed in the
+ * _MONSTERWM_MATCHES property of the root window, or the next match after
+ * the focused window is focused */
+void query(Bool jump, Bool prefix) {
+    XTextProperty tp;
+    char **list = NULL;
+    int n = 0, m = 0;
+    if (!be->GetTextProperty(dis, root, &tp, queryatom)) return;
+    if (Xutf8TextPropertyToTextList(dis, &tp, &list, &n) >= Success && n > 0 && *list) {
+        char *q = lowered(*list);
+        if (titledue) retitle(True);
+        if (jump) {
+            client *c = search(q, prefix, current);
+            if (c) jumpto(c);
+        } else {
+            Window *w = scratch(nbyname*sizeof(Window));
+            for (int i=0; i<nbyname; i++) if (matches(byname[i]->key, q, prefix)) w[m++] = byname[i]->win;
+            be->ChangeProperty(dis, root, matchatom, XA_WINDOW, 32, PropModeReplace, (unsigned char *)w, m);
+        }
+    }
+    if (list) XFreeStringList(list);
+    if (tp.value) XFree(tp.value);
+}
+
+/* read the titles that changed, only the focused window's unless all, and
+ * publish them if they did. the desktop info is printed again only if the
+ * focused window's title is not the one last printed */
+void retitle(Bool all) {
+    client *f = current;
+    int sc = cs, cd;
+    if (all) {
+        titledue = 0;
+        for (int s=0; s<nscreens; s++) {
+            select_screen(s);
+            cd = current_desktop;
+            for (int d=0; d<DESKTOPS; d++) {
+                select_desktop(d);
+                for (client *c=head; c; c=c->next) if (c->newtitle && gettitle(c)) dirty = True;
+            }
+            select_desktop(cd);
+        }
+        select_screen(sc);
+    } else if (f && f->newtitle && gettitle(f)) dirty = True;
+    if (strcmp(f ? f->title:"", shown)) desktopinfo();
+}
+
+/* rebuild the client's search key from its class, instance and title */
+void rekey(client *c) {
+    char *p = c->key;
+    for (const char *s = c->class; *s; ) *p++ = tolower((unsigned char)*s++);
+    *p++ = '\n';
+    for (const char *s = c->instance; *s; ) *p++ = tolower((unsigned char)*s++);
+    *p++ = '\n';
+    for (const char *s = c->title; *s; ) *p++ = tolower((unsigned char)*s++);
+    *p++ = '\n'; *p = '\0';
+}
+
+/* reload the configuration module named by MONSTERWM_CONFIG, or use the
+ * compiled in configuration if there is none
+ *
+ * the new module is loaded and checked before the old one is closed, and
+ * the configuration in use is kept if it cannot be loaded. only the state derived from what changed is rebuilt: the key grabs, the
+ * button grabs, the border colors and the layout of every desktop, on
+ * every screen */
+void reload(void) {
+    const char *path = getenv("MONSTERWM_CONFIG");
+    const config *prev = cfg, *m = &builtin;
+    void *old = module;
+    int sc = cs, cd;
+
+    if (path && !(m = loadconfig(path))) { warnx("keeping the configuration in use"); return; }
+
+    Bool regrabkeys = m->nkeys != prev->nkeys, regrabbuttons = m->nbuttons != prev->nbuttons,
+         relayout = m->mastersize != prev->mastersize || m->borderwidth != prev->borderwidth;
+    for (unsigned int i=0; i<m->nkeys && !regrabkeys; i++)
+        regrabkeys = m->keys[i].mod != prev->keys[i].mod || m->keys[i].keysym != prev->keys[i].keysym;
+    for (unsigned int i=0; i<m->nbuttons && !regrabbuttons; i++)
+        regrabbuttons = m->buttons[i].mask != prev->buttons[i].mask || m->buttons[i].button != prev->buttons[i].button;
+    cfg = m;
+    if (prev != &builtin) free((void *)prev);
+    if (old) dlclose(old);
+
+    for (int s=0; s<nscreens; s++) {
+        select_screen(s);
+        unsigned long focus = getcolor(m->focus), unfocus = getcolor(m->unfocus);
+        Bool recolor = focus != win_focus || unfocus != win_unfocus;
+        win_focus = focus; win_unfocus = unfocus;
+
+        if (regrabkeys) grabkeys();
+        cd = current_desktop;
+        for (int d=0; d<DESKTOPS && regrabbuttons; d++) {
+            select_desktop(d);
+            for (client *c=head; c; c=c->next) {
+                be->UngrabButton(dis, AnyButton, AnyModifier, c->win);
+                grabbuttons(c);
+                if (CLICK_TO_FOCUS && c != current) be->GrabButton(dis, Button1, None, c->win, True,
+                        ButtonPressMask, GrabModeAsync, GrabModeAsync, None, None);
+            }
+        }
+        select_desktop(cd);
+        if (relayout) { stale |= ((1 << DESKTOPS) - 1) & ~(1 << current_desktop); tile(); }
+        if (regrabbuttons || recolor || relayout) update_current(current);
+    }
+    select_screen(sc);
+}
+
+/* move the client to the front of the selected desktop's focus history */
+void remember(client *c) {
+    if (c == recent) return;
+    forget(c, False);
+    if ((c->older = recent)) recent->newer = c;
+    recent = c;
+}
+
 /* remove the specified client
  *
  * note, the removing client can be on any desktop,
  * we must return back to the current focused desktop.
- * if c was the previously focused, prevfocus must be updated
- * else if c was the current one, current must be updated. */
+ * if c was the current one, the previously focused client takes over. */
 void removeclient(client *c) {
-    client **p = NULL;
-    int nd = 0, cd = current_desktop;
-    for (Bool found = False; nd<DESKTOPS && !found; nd++)
-        for (select_desktop(nd), p = &head; *p && !(found = *p == c); p = &(*p)->next);
-    *p = c->next;
-    if (c == prevfocus) prevfocus = prev_client(current);
-    if (c == current || !head->next) update_current(prevfocus);
+    int cd = current_desktop, nd = detach(c);
+    forget(c, True);
+    settags(c, 0);
+    be->DeleteContext(dis, c->win, screenctx);
+    be->DeleteContext(dis, c->win, clientctx);
+    (byname[c->slot] = byname[--nbyname])->slot = c->slot;
+    nclients--;
+    PROBE(client__remove, c->win);
     free(c); c = NULL;
-    if (cd == nd -1) tile(); else select_desktop(cd);
+    freed++;
+    if (cd == nd) tile(); else { select_desktop(cd); if (nd >= 0) stale |= 1 << nd; }
+}
+
+/* move and resize the client's window and keep track of its geometry */
+void resize(client *c, int x, int y, int w, int h) {
+    XMVRSZ(dis, c->win, (c->x = x), (c->y = y), (c->w = w), (c->h = h));
+    reindex(c);
+    dirty = True;
 }
 
 /* resize the master window - check for boundary size limits
  * the size of a window can't be less than MINWSZ
  */
 void resize_master(const Arg *arg) {
-    int msz = (mode == BSTACK ? wh:ww) * MASTER_SIZE + master_size + arg->i;
+    int msz = (mode == BSTACK ? wh:ww) * cfg->mastersize + master_size + arg->i;
     if (msz < MINWSZ || (mode == BSTACK ? wh:ww) - msz < MINWSZ) return;
     master_size += arg->i;
     tile();
@@ -707,6 +2135,164 @@ void resize_stack(const Arg *arg) {
     tile();
 }
 
+/* replace the wm with a new process of the binary it was started from, to
+ * upgrade it in place. the state is written to an unlinked shared memory
+ * object, whose descriptor is passed in MONSTERWM_RESTART, see resume().
+ * the containers outlive the connection with RetainPermanent, so the
+ * windows stay where they are, and as they are, until taken over */
+void restart(void) {
+    char name[32];
+    snprintf(name, sizeof name, "/monsterwm-restart-%ld", (long)getpid());
+    int fd = shm_open(name, O_RDWR|O_CREAT|O_EXCL, 0600);
+    FILE *f = fd < 0 ? NULL:fdopen(fd, "w+");
+    if (fd >= 0) shm_unlink(name);
+    if (!f || fcntl(fd, F_SETFD, 0) < 0) {
+        warn("cannot save the state to restart");
+        if (f) fclose(f); else if (fd >= 0) close(fd);
+        return;
+    }
+
+    /* bring the state up to date, nothing is left for later */
+    if (batch) commit();
+    if (deferred) flushdeferred();
+    while (prelayout());
+    retitle(True);
+    if (cycled) promote(cycled);
+
+    int sc = cs, n = 0;
+    restartclient rc;
+    fwrite(&(restartheader){ RESTART_ABI, sizeof rc, nscreens, DESKTOPS, container }, sizeof(restartheader), 1, f);
+    for (int s=0; s<nscreens; s++) {
+        select_screen(s);
+        save_desktop(current_desktop);
+        fwrite(&(restartscreen){ visible, previous_desktop }, sizeof(restartscreen), 1, f);
+        for (int d=0; d<DESKTOPS; d++) {
+            desktop *k = &desktops[d];
+            restartdesktop rd = { k->mode, k->growth, k->scroll, 0, 0, k->master_size, k->showpanel };
+            client *c;
+            for (c=k->head; c; c=c->next) rd.nclients++;
+            for (c=k->recent; c; c=c->older) rd.nrecent++;
+            fwrite(&rd, sizeof rd, 1, f);
+            for (c=k->head; c; c=c->next) {
+                rc = (restartclient){ c->win, c->isurgent, c->istransient, c->isfullscrn, c->isfloating,
+                                      c->paged, c->x, c->y, c->w, c->h, c->desktop, c->tags, "", "", "" };
+                memcpy(rc.title, c->title, TITLE_LENGTH);
+                memcpy(rc.class, c->class, NAME_LENGTH);
+                memcpy(rc.instance, c->instance, NAME_LENGTH);
+                fwrite(&rc, sizeof rc, 1, f);
+            }
+            for (c=k->recent; c; c=c->older) fwrite(&c->win, sizeof(Window), 1, f);
+        }
+    }
+    select_screen(sc);
+    for (client *c=latest; c; c=c->golder) n++;
+    fwrite(&n, sizeof n, 1, f);
+    for (client *c=latest; c; c=c->golder) fwrite(&c->win, sizeof(Window), 1, f);
+    if (fflush(f) || ferror(f)) { warnx("cannot save the state to restart"); fclose(f); return; }
+
+    snprintf(name, sizeof name, "%d", fd);
+    setenv("MONSTERWM_RESTART", name, 1);
+    Window w = container;
+    XSetCloseDownMode(dis, RetainPermanent);
+    XCloseDisplay(dis);
+    if (shm) shm_unlink(shmname);
+    execvp(arguments[0], arguments);
+    /* give the windows back to the root window through the save set */
+    if ((dis = XOpenDisplay(NULL))) { XKillClient(dis, w); XCloseDisplay(dis); }
+    err(EXIT_FAILURE, "cannot restart %s", arguments[0]);
+}
+
+/* take over the windows of the process restart() replaced, from the state
+ * it handed over. the windows are reparented into the new containers where
+ * they are, without querying them or tiling the desktops again, and the old
+ * containers are destroyed. windows that went away meanwhile are removed,
+ * and if the state can't be used, the old process' resources are destroyed
+ * right away, so its save set gives the windows back to be managed anew */
+void resume(int fd) {
+    FILE *f = fdopen(fd, "r");
+    restartheader h = { 0 };
+    if (!f || fseek(f, 0, SEEK_SET) || fread(&h, sizeof h, 1, f) != 1) {
+        warn("cannot read the state to resume");
+        if (f) fclose(f); else close(fd);
+        return;
+    }
+    if (h.abi != RESTART_ABI || h.clientsize != sizeof(restartclient)
+        || h.nscreens != nscreens || h.desktops != DESKTOPS) {
+        warnx("cannot resume from a different version's state");
+        be->KillClient(dis, h.container);
+        fclose(f);
+        return;
+    }
+
+    restartclient rc;
+    Window w, *children;
+    unsigned int nchildren;
+    client *c;
+    for (int s=0; s<nscreens; s++) {
+        restartscreen rs = { current_desktop, previous_desktop };
+        select_screen(s);
+        int cd = current_desktop;
+        if (fread(&rs, sizeof rs, 1, f) != 1 || rs.visible < 0 || rs.visible >= DESKTOPS) rs.visible = cd;
+        for (int d=0; d<DESKTOPS; d++) {
+            restartdesktop rd = { mode, growth, scroll, 0, 0, 0, showpanel };
+            select_desktop(d);
+            if (fread(&rd, sizeof rd, 1, f) != 1) rd.nclients = rd.nrecent = 0;
+            mode = rd.mode; growth = rd.growth; scroll = rd.scroll;
+            master_size = rd.master_size; showpanel = rd.showpanel;
+            client **l = scratch(rd.nclients*sizeof(client *));
+            int n = 0;
+            for (; n<rd.nclients && fread(&rc, sizeof rc, 1, f) == 1; n++) {
+                c = l[n] = addwindow(rc.win);
+                c->isurgent = rc.isurgent; c->istransient = rc.istransient;
+                c->isfullscrn = rc.isfullscrn; c->isfloating = rc.isfloating; c->paged = rc.paged;
+                c->x = rc.x; c->y = rc.y; c->w = rc.w; c->h = rc.h; c->desktop = rc.desktop;
+                snprintf(c->title, TITLE_LENGTH, "%s", rc.title);
+                snprintf(c->class, NAME_LENGTH, "%s", rc.class);
+                snprintf(c->instance, NAME_LENGTH, "%s", rc.instance);
+                rekey(c);
+                reindex(c);
+                settags(c, rc.tags);
+                be->AddToSaveSet(dis, c->win);
+                be->ReparentWindow(dis, c->win, container, c->x, c->y);
+                grabbuttons(c);
+            }
+            for (head = NULL; n--; head = l[n]) l[n]->next = head;
+            Window *r = scratch(rd.nrecent*sizeof(Window));
+            n = fread(r, sizeof(Window), rd.nrecent, f);
+            while (n--) if ((c = wintoclient(r[n]))) remember(c);
+            current = recent ? recent:head;
+            for (c=head; c && CLICK_TO_FOCUS; c=c->next) if (c != current) be->GrabButton(dis, Button1, None,
+                        c->win, True, ButtonPressMask, GrabModeAsync, GrabModeAsync, None, None);
+        }
+        select_desktop(cd);
+        if (rs.visible != cd) change_desktop(&(Arg){.i = rs.visible}); else update_current(current);
+        previous_desktop = rs.previous_desktop;
+    }
+    int n = 0;
+    if (fread(&n, sizeof n, 1, f) == 1 && n > 0) {
+        Window *r = scratch(n*sizeof(Window));
+        n = fread(r, sizeof(Window), n, f);
+        while (n--) if ((c = wintoclient(r[n]))) promote(c);
+    }
+    fclose(f);
+
+    /* the windows reparented are the ones still there */
+    marks++;
+    for (int s=0; s<nscreens; s++) for (int d=0; d<DESKTOPS; d++) {
+        if (!be->QueryTree(dis, screens[s].desktops[d].container, &w, &w, &children, &nchildren)) continue;
+        for (unsigned int i=0; i<nchildren; i++) if ((c = wintoclient(children[i]))) c->mark = marks;
+        if (children) XFree(children);
+    }
+    for (int i=nbyname; i--; ) if ((c = byname[i])->mark != marks) {
+        XPointer p;
+        if (!be->FindContext(dis, c->win, screenctx, &p)) select_screen((intptr_t)p);
+        removeclient(c);
+    }
+    be->KillClient(dis, h.container);
+    scratchreset();
+    dirty = True;
+}
+
 /* jump and focus the next or previous desktop */
 void rotate(const Arg *arg) {
     change_desktop(&(Arg){.i = (DESKTOPS + current_desktop + arg->i) % DESKTOPS});
@@ -719,10 +2305,87 @@ void rotate_filled(const Arg *arg) {
     change_desktop(&(Arg){.i = (DESKTOPS + current_desktop + n) % DESKTOPS});
 }
 
-/* main event loop - on receival of an event call the appropriate event handler */
+/* main event loop - on receival of an event call the appropriate event handler
+ *
+ * when the queue is empty wait on the connection, but if events have been
+ * throttled wait no longer than their deadline and then flush them, so that
+ * even a window that never stops sending events gets its trailing update.
+ * the same goes for batches that are never committed. a burst of windows
+ * going away is committed once a sync brings in no more events.
+ * the shared state is published once the queue has been drained, or every
+ * PUBLISH_INTERVAL while events keep coming, and
+ * events are handled on the screen of the root, container or client window
+ * they are reported to, found through its context in O(1).
+ * stale hidden desktops are tiled one at a time while the queue is empty.
+ * the focused window's title is read once the queue is empty, the other
+ * titles once TITLE_INTERVAL has passed since the first of them changed.
+ * every handler's duration is recorded for the samples, and the scratch
+ * memory used by the batch is released */
 void run(void) {
-    XEvent ev;
-    while(running && !XNextEvent(dis, &ev)) if (events[ev.type]) events[ev.type](&ev);
+    XEvent ev; fd_set fds; XPointer p;
+    int fd = be->ConnectionNumber(dis);
+    while (running) {
+        loop.heartbeat++; loop.type = 0;
+        if (dumpstats) STEP(stats, ());
+        if (deferred && mstime() >= deadline) STEP(flushdeferred, ());
+        if (batch && mstime() >= batchend) STEP(commit, ());
+        if (SAMPLE_INTERVAL && mstime() >= nextsample) STEP(sample, ());
+        if (titledue && !batch && mstime() >= titledue) STEP(retitle, (True));
+        if (dirty && !batch && mstime() >= published + PUBLISH_INTERVAL) STEP(publish, ());
+        loop.phase = "XPending";
+        if (XPending(dis)) {
+            XNextEvent(dis, &ev);
+            if (nscreens > 1 && !be->FindContext(dis, ev.xany.window, screenctx, &p)) select_screen((intptr_t)p);
+            PROBE_EVENT(event__entry, ev.type, ev.xany.window);
+            loop.phase = "event"; loop.type = ev.type; loop.win = ev.xany.window;
+            long t0 = ustime();
+            if (events[ev.type]) events[ev.type](&ev);
+            t0 = ustime() - t0;
+            record(&evlatency, t0);
+            record(&samplelatency, t0);
+            PROBE_EVENT(event__exit, ev.type, ev.xany.window);
+            continue;
+        }
+        if (burst) {
+            be->Sync(dis, False);
+            if (XPending(dis)) continue;
+            STEP(commit, ());
+        }
+        if (moving.moved) STEP(dragmove, ());
+        if (!batch) STEP(retitle, (False));
+        if (dirty && !batch) STEP(publish, ());
+        scratchreset();
+        if (!batch && STEP(prelayout, ())) continue;
+        long t = timeout();
+        struct timeval tv = { t/1000, t%1000*1000 };
+        FD_ZERO(&fds); FD_SET(fd, &fds);
+        loop.busy = 0;
+        select(fd + 1, &fds, NULL, NULL, t < 0 ? NULL:&tv);
+        loop.busy = 1;
+        wakeups++; samplewakeups++;
+    }
+}
+
+/* output a sample of the wm's resource usage on standard error stream
+ * and start a new sampling interval, see stats() for the format */
+void sample(void) {
+    long rss = 0;
+    size_t heap = 0;
+#ifdef MALLINFO2
+    struct mallinfo2 m = mallinfo2();
+    heap = m.uordblks + m.hblkhd;
+#endif
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f) { if (fscanf(f, "%*d %ld", &rss) != 1) rss = 0; fclose(f); }
+    fprintf(stderr, "sample:%ld:%ld:%zu:%d:%lu:%lu:%lu:%ld:%ld:%lu:%lu\n", (mstime() - started)/1000,
+            rss * (sysconf(_SC_PAGESIZE)/1024), heap/1024, nclients,
+            allocated, freed, samplelatency.n,
+            percentile(&samplelatency, 50), percentile(&samplelatency, 99), samplelatency.max,
+            samplewakeups/(SAMPLE_INTERVAL ? SAMPLE_INTERVAL:1));
+    fflush(stderr);
+    samplewakeups = 0;
+    memset(&samplelatency, 0, sizeof samplelatency);
+    nextsample = mstime() + SAMPLE_INTERVAL*1000;
 }
 
 /* save specified desktop's properties */
@@ -731,10 +2394,58 @@ void save_desktop(int i) {
     desktops[i].master_size = master_size;
     desktops[i].mode        = mode;
     desktops[i].growth      = growth;
+    desktops[i].scroll      = scroll;
     desktops[i].head        = head;
     desktops[i].current     = current;
     desktops[i].showpanel   = showpanel;
-    desktops[i].prevfocus   = prevfocus;
+    desktops[i].recent      = recent;
+    desktops[i].cells       = cells;
+    desktops[i].container   = container;
+}
+
+/* get n bytes of scratch memory, released once the event batch is handled
+ * memory that does not fit is taken from the heap, and the arena grows to
+ * fit it on the next reset, so in steady state no event touches the heap */
+void* scratch(size_t n) {
+    n = (n + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+    if (arena.used + n <= arena.size) return arena.buf + (arena.used += n) - n;
+    void **k = malloc(ALIGN + n);
+    if (!k) err(EXIT_FAILURE, "cannot allocate scratch memory");
+    *k = arena.extra; arena.extra = k;
+    arena.spills++;
+    if (arena.used + (arena.spilled += n) > arena.peak) arena.peak = arena.used + arena.spilled;
+    return (char *)k + ALIGN;
+}
+
+/* release all scratch memory, growing the arena if the batch did not fit */
+void scratchreset(void) {
+    char *buf;
+    for (void **k; (k = arena.extra); free(k)) arena.extra = *k;
+    if (arena.spilled && (buf = realloc(arena.buf, arena.peak))) { arena.buf = buf; arena.size = arena.peak; }
+    arena.used = arena.spilled = 0;
+}
+
+/* find the first window in the search index after the given one, cycling,
+ * whose key matches the lower case query */
+client* search(const char *q, Bool prefix, client *after) {
+    int first = after ? after->slot + 1:0;
+    for (int i=0; i<nbyname; i++) {
+        client *c = byname[(first + i) % nbyname];
+        if (matches(c->key, q, prefix)) return c;
+    }
+    return NULL;
+}
+
+/* select the events the client reports, all of CLIENTMASK while it can be
+ * seen, only HIDDENMASK while its desktop is hidden or it is covered in
+ * monocle mode, so that titles and urgency are still followed */
+void selectmask(client *c, Bool seen) {
+    long mask = seen ? CLIENTMASK:HIDDENMASK;
+    if (mask == c->mask) return;
+    be->SelectInput(dis, c->win, (c->mask = mask));
+#ifdef XINPUT2
+    if (FOLLOW_MOUSE && xiopcode) xiselect(c->win, seen ? XI_EnterMask:0);
+#endif
 }
 
 /* set the specified desktop's properties */
@@ -744,66 +2455,243 @@ void select_desktop(int i) {
     master_size     = desktops[i].master_size;
     mode            = desktops[i].mode;
     growth          = desktops[i].growth;
+    scroll          = desktops[i].scroll;
     head            = desktops[i].head;
     current         = desktops[i].current;
     showpanel       = desktops[i].showpanel;
-    prevfocus       = desktops[i].prevfocus;
+    recent          = desktops[i].recent;
+    cells           = desktops[i].cells;
+    container       = desktops[i].container;
     current_desktop = i;
 }
 
+/* save the selected screen's state and switch to the given screen's */
+void select_screen(int i) {
+    if (i < 0 || i >= nscreens || i == cs) return;
+    xscreen *s = &screens[cs];
+    save_desktop(current_desktop);
+    s->current_desktop  = current_desktop;
+    s->previous_desktop = previous_desktop;
+    s->visible          = visible;
+    s->stale            = stale;
+    s->touched          = touched;
+    s->focus            = win_focus;
+    s->unfocus          = win_unfocus;
+    s = &screens[cs = i];
+    root             = s->root;
+    screen           = s->num;
+    ww               = s->ww;
+    wh               = s->wh;
+    previous_desktop = s->previous_desktop;
+    visible          = s->visible;
+    stale            = s->stale;
+    touched          = s->touched;
+    win_focus        = s->focus;
+    win_unfocus      = s->unfocus;
+    desktops         = s->desktops;
+    views            = s->views;
+    current_desktop  = -1;
+    select_desktop(s->current_desktop);
+}
+
+/* move the client to the end of the given desktop's list and focus it there
+ * the window is reparented into the desktop's container right away, but
+ * the layout waits for the commit. only to be used inside a batch */
+void sendtodesktop(client *c, int d) {
+    int cd = current_desktop, sd = detach(c);
+    if (sd < 0) { select_desktop(cd); return; }
+    c->next = NULL;
+    select_desktop(d);
+    client *l = prev_client(head);
+    update_current(l ? (l->next = c):head ? (head->next = c):(head = c));
+    c->cells = cells;
+    reindex(c);
+    be->ReparentWindow(dis, c->win, container, c->x, c->y);
+    if (!c->paged) c->unmaps++;
+    touched |= 1 << sd;
+    select_desktop(cd);
+}
+
+/* hide a stack window scrolled off the page, or show it again once it is
+ * back on it. the unmap is counted, so the window stays managed */
+void setpaged(client *c, Bool paged) {
+    if (c->paged == paged) return;
+    if ((c->paged = paged)) { c->unmaps++; be->UnmapWindow(dis, c->win); }
+    else be->MapWindow(dis, c->win);
+}
+
 /* set or unset fullscreen state of client */
 void setfullscreen(client *c, Bool fullscrn) {
-    if (fullscrn != c->isfullscrn) XChangeProperty(dis, c->win,
+    if (fullscrn != c->isfullscrn) be->ChangeProperty(dis, c->win,
             netatoms[NET_WM_STATE], XA_ATOM, 32, PropModeReplace, (unsigned char*)
             ((c->isfullscrn = fullscrn) ? &netatoms[NET_FULLSCREEN]:0), fullscrn);
-    if (fullscrn) XMVRSZ(dis, c->win, 0, 0, ww, wh + PANEL_HEIGHT);
-    XConfigureWindow(dis, c->win, CWBorderWidth, &(XWindowChanges){0,0,0,0,fullscrn?0:BORDER_WIDTH,0,0});
+    if (fullscrn) resize(c, 0, 0, ww, wh + PANEL_HEIGHT);
+    be->ConfigureWindow(dis, c->win, CWBorderWidth, &(XWindowChanges){0,0,0,0,fullscrn?0:cfg->borderwidth,0,0});
+}
+
+/* create the shared memory region for the desktop state
+ * and tell readers where to find it, through the environment
+ * of spawned commands and a property on the root window.
+ * the region is the user's own and always a new one, a name that is
+ * already taken is passed over rather than opened */
+void setupshm(void) {
+    size_t size = sizeof(shmheader) + nscreens*DESKTOPS*sizeof(shmdesktop) + SHM_CLIENTS*sizeof(shmclient);
+    int fd, n = 0;
+    do {
+        snprintf(shmname, sizeof shmname, "/monsterwm-%ld-%d", (long)getpid(), n);
+        fd = shm_open(shmname, O_RDWR|O_CREAT|O_EXCL, 0600);
+    } while (fd < 0 && errno == EEXIST && ++n < SHM_NAMES);
+    if (fd < 0 || ftruncate(fd, size) < 0
+        || (shm = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        warn("cannot create shared state %s", shmname);
+        if (fd >= 0) { close(fd); shm_unlink(shmname); }
+        shm = NULL;
+        return;
+    }
+    close(fd);
+    *shm = (shmheader){ 0, 3, nscreens*DESKTOPS, 0, 0, 0 };
+    setenv("MONSTERWM_STATE", shmname, 1);
+    for (int s=0; s<nscreens; s++)
+        be->ChangeProperty(dis, screens[s].root, be->InternAtom(dis, "_MONSTERWM_STATE", False), XA_STRING, 8,
+                        PropModeReplace, (unsigned char *)shmname, strlen(shmname));
+    dirty = True;
+}
+
+/* set the desktops a window is shown on, and update the views of only
+ * the desktops whose tag changed */
+void settags(client *c, unsigned int tags) {
+    for (int d=0; d<DESKTOPS; d++) {
+        view *v = &views[d];
+        if (!((c->tags ^ tags) & 1 << d)) continue;
+        if (tags & 1 << d) {
+            if (v->n == v->size && !(v->c = realloc(v->c, (v->size = 2*v->size + 4)*sizeof(client *))))
+                err(EXIT_FAILURE, "cannot allocate view");
+            v->c[v->n++] = c;
+        } else for (int k=0; k<v->n; k++) if (v->c[k] == c) { v->c[k] = v->c[--v->n]; break; }
+    }
+    c->tags = tags;
 }
 
 /* set initial values
- * root window - screen height/width - atoms - xerror handler
+ * root windows - screen heights/widths - atoms - xerror handler
  * set masks for reporting events handled by the wm
  * and propagate the suported net atoms */
 void setup(void) {
     sigchld();
+    nextsample = (started = mstime()) + SAMPLE_INTERVAL*1000;
+    if (signal(SIGUSR1, sigusr1) == SIG_ERR)
+        err(EXIT_FAILURE, "cannot install SIGUSR1 handler");
+    /* the stall log is the user's own, a link planted in its place is not followed,
+     * and the wm runs without the watchdog if it can't be opened */
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    char log[256];
+    int fd = -1;
+    if (STALL_TIMEOUT && !dir) warnx("XDG_RUNTIME_DIR is not set, the watchdog is off");
+    else if (STALL_TIMEOUT && (snprintf(log, sizeof log, "%s/%s", dir, STALL_LOG) >= (int)sizeof log
+             || (fd = open(log, O_WRONLY|O_CREAT|O_APPEND|O_NOFOLLOW|O_CLOEXEC, 0600)) < 0
+             || !(stalllog = fdopen(fd, "a")))) {
+        warn("cannot open %s, the watchdog is off", log);
+        if (fd >= 0) close(fd);
+    }
+    if (stalllog) {
+        void *frame;
+        pthread_t t;
+        sigset_t all, old;
+        backtrace(&frame, 1);
+        mainthread = pthread_self();
+        loop.busy = 1; loop.phase = "setup";
+        /* the watchdog inherits a full mask, so SIGCHLD, SIGHUP and friends
+         * keep being handled by the main thread only */
+        sigfillset(&all);
+        if (signal(SIGUSR2, sigusr2) == SIG_ERR || pthread_sigmask(SIG_SETMASK, &all, &old)
+                || pthread_create(&t, NULL, watchdog, NULL) || pthread_sigmask(SIG_SETMASK, &old, NULL))
+            err(EXIT_FAILURE, "cannot start the watchdog");
+    }
 
-    screen = DefaultScreen(dis);
-    root = RootWindow(dis, screen);
-
-    ww = XDisplayWidth(dis,  screen);
-    wh = XDisplayHeight(dis, screen) - PANEL_HEIGHT;
-    for (unsigned int i=0; i<DESKTOPS; i++) save_desktop(i);
+    const char *path = getenv("MONSTERWM_CONFIG");
+    const config *m = path ? loadconfig(path):NULL;
+    if (m) cfg = m;
 
-    win_focus = getcolor(FOCUS);
-    win_unfocus = getcolor(UNFOCUS);
+#if defined XINPUT2 && !defined MOCK
+    /* raw events reach the root window during grabs from version 2.1 on */
+    int xev, xerr, major = 2, minor = 2;
+    if (!XQueryExtension(dis, "XInputExtension", &xiopcode, &xev, &xerr)
+        || XIQueryVersion(dis, &major, &minor) != Success || (major == 2 && minor < 1)) xiopcode = 0;
+#endif
 
-    XModifierKeymap *modmap = XGetModifierMapping(dis);
+    XModifierKeymap *modmap = be->GetModifierMapping(dis);
     for (int k=0; k<8; k++) for (int j=0; j<modmap->max_keypermod; j++)
-        if (modmap->modifiermap[modmap->max_keypermod*k + j] == XKeysymToKeycode(dis, XK_Num_Lock))
+        if (modmap->modifiermap[modmap->max_keypermod*k + j] == be->KeysymToKeycode(dis, XK_Num_Lock))
             numlockmask = (1 << k);
     XFreeModifiermap(modmap);
 
     /* set up atoms for dialog/notification windows */
-    wmatoms[WM_PROTOCOLS]     = XInternAtom(dis, "WM_PROTOCOLS",     False);
-    wmatoms[WM_DELETE_WINDOW] = XInternAtom(dis, "WM_DELETE_WINDOW", False);
-    netatoms[NET_SUPPORTED]   = XInternAtom(dis, "_NET_SUPPORTED",   False);
-    netatoms[NET_WM_STATE]    = XInternAtom(dis, "_NET_WM_STATE",    False);
-    netatoms[NET_ACTIVE]      = XInternAtom(dis, "_NET_ACTIVE_WINDOW",       False);
-    netatoms[NET_FULLSCREEN]  = XInternAtom(dis, "_NET_WM_STATE_FULLSCREEN", False);
+    wmatoms[WM_PROTOCOLS]     = be->InternAtom(dis, "WM_PROTOCOLS",     False);
+    wmatoms[WM_DELETE_WINDOW] = be->InternAtom(dis, "WM_DELETE_WINDOW", False);
+    netatoms[NET_SUPPORTED]   = be->InternAtom(dis, "_NET_SUPPORTED",   False);
+    netatoms[NET_WM_STATE]    = be->InternAtom(dis, "_NET_WM_STATE",    False);
+    netatoms[NET_ACTIVE]      = be->InternAtom(dis, "_NET_ACTIVE_WINDOW",       False);
+    netatoms[NET_FULLSCREEN]  = be->InternAtom(dis, "_NET_WM_STATE_FULLSCREEN", False);
+    netatoms[NET_WM_NAME]     = be->InternAtom(dis, "_NET_WM_NAME",             False);
+    cmdatom                   = be->InternAtom(dis, "_MONSTERWM_COMMAND",       False);
+    stampatom                 = be->InternAtom(dis, "_MONSTERWM_TIMESTAMP",     False);
+    queryatom                 = be->InternAtom(dis, "_MONSTERWM_QUERY",         False);
+    matchatom                 = be->InternAtom(dis, "_MONSTERWM_MATCHES",       False);
+    startupatom               = be->InternAtom(dis, "_NET_STARTUP_ID",          False);
+    pidatom                   = be->InternAtom(dis, "_NET_WM_PID",              False);
+
+    /* every screen gets its own set of desktops, each with its container */
+    screenctx = XUniqueContext();
+    clientctx = XUniqueContext();
+    nscreens = be->ScreenCount(dis);
+    if (!(screens = calloc(nscreens, sizeof(xscreen)))) err(EXIT_FAILURE, "cannot allocate screens");
+    for (int s=0; s<nscreens; s++)
+        if (!(screens[s].desktops = calloc(DESKTOPS, sizeof(desktop)))
+         || !(screens[s].views = calloc(DESKTOPS, sizeof(view)))) err(EXIT_FAILURE, "cannot allocate desktops");
+    desktops = screens[0].desktops;
+    views = screens[0].views;
+    XSetWindowAttributes cwa = { .background_pixmap = ParentRelative, .override_redirect = True,
+                                 .event_mask = CONTAINERMASK };
 
     /* check if another window manager is running */
     xerrorxlib = XSetErrorHandler(xerrorstart);
-    XSelectInput(dis, DefaultRootWindow(dis), SubstructureRedirectMask|ButtonPressMask|
-                                              SubstructureNotifyMask|PropertyChangeMask);
-    XSync(dis, False);
+    for (int s=0; s<nscreens; s++) {
+        select_screen(s);
+        root = screens[s].root = be->RootWindow(dis, (screen = screens[s].num = s));
+        ww = screens[s].ww = be->DisplayWidth(dis, screen);
+        wh = screens[s].wh = be->DisplayHeight(dis, screen) - PANEL_HEIGHT;
+        mode = DEFAULT_MODE; showpanel = SHOW_PANEL; master_size = growth = scroll = 0;
+        be->SaveContext(dis, root, screenctx, (XPointer)(intptr_t)s);
+        for (unsigned int i=0; i<DESKTOPS; i++) {
+            if (!(cells = calloc(GRID_CELLS*GRID_CELLS, sizeof(cell)))) err(EXIT_FAILURE, "cannot allocate grid");
+            container = be->CreateWindow(dis, root, 0, 0, ww, wh + PANEL_HEIGHT, 0, CopyFromParent, InputOutput,
+                            CopyFromParent, CWBackPixmap|CWOverrideRedirect|CWEventMask, &cwa);
+            be->SaveContext(dis, container, screenctx, (XPointer)(intptr_t)s);
+            be->LowerWindow(dis, container);
+            save_desktop(i);
+        }
+        cells = desktops[current_desktop].cells;
+        be->MapWindow(dis, (container = desktops[(visible = current_desktop)].container));
+        win_focus = getcolor(cfg->focus);
+        win_unfocus = getcolor(cfg->unfocus);
+        be->SelectInput(dis, root, ROOTMASK);
+    }
+    be->Sync(dis, False);
 
     XSetErrorHandler(xerror);
-    XSync(dis, False);
-    XChangeProperty(dis, root, netatoms[NET_SUPPORTED], XA_ATOM, 32,
-              PropModeReplace, (unsigned char *)netatoms, NET_COUNT);
-
-    grabkeys();
-    change_desktop(&(Arg){.i = DEFAULT_DESKTOP});
+    be->Sync(dis, False);
+    if (SHM_CLIENTS) setupshm();
+
+    for (int s=0; s<nscreens; s++) {
+        select_screen(s);
+        be->ChangeProperty(dis, root, netatoms[NET_SUPPORTED], XA_ATOM, 32,
+                  PropModeReplace, (unsigned char *)netatoms, NET_COUNT);
+        grabkeys();
+        change_desktop(&(Arg){.i = DEFAULT_DESKTOP});
+    }
+    const char *state = getenv("MONSTERWM_RESTART");
+    if (state) { resume(atoi(state)); unsetenv("MONSTERWM_RESTART"); }
+    select_screen(be->DefaultScreen(dis));
 }
 
 void sigchld() {
@@ -812,11 +2700,63 @@ void sigchld() {
     while(0 < waitpid(-1, NULL, WNOHANG));
 }
 
-/* execute a command */
+/* request a stats dump, it is printed by run() once the handler returns */
+void sigusr1() {
+    if (signal(SIGUSR1, sigusr1) == SIG_ERR)
+        err(EXIT_FAILURE, "cannot install SIGUSR1 handler");
+    dumpstats = 1;
+}
+
+/* sent by the watchdog to the stalled main thread, write its stack to the
+ * stall log. backtrace() was called once in setup, so that it does not
+ * have to load anything here */
+void sigusr2() {
+    if (signal(SIGUSR2, sigusr2) == SIG_ERR)
+        err(EXIT_FAILURE, "cannot install SIGUSR2 handler");
+    void *frames[32];
+    backtrace_symbols_fd(frames, backtrace(frames, LENGTH(frames)), fileno(stalllog));
+}
+
+/* snap the position of a moved window to the screen edges, and to the
+ * edges of the windows around it, when they are closer than SNAP pixels */
+void snap(client *c, int *x, int *y) {
+    int bx = SNAP + 1, by = SNAP + 1, sx = *x, sy = *y, bw = 2*cfg->borderwidth;
+    int edges[4] = { 0, ww - c->w - bw, TOP_PANEL && showpanel ? PANEL_HEIGHT:0, wh + PANEL_HEIGHT - c->h - bw };
+    for (int i=0; i<2; i++) {
+        if (abs(edges[i] - sx) < abs(bx)) bx = edges[i] - sx;
+        if (abs(edges[i + 2] - sy) < abs(by)) by = edges[i + 2] - sy;
+    }
+    for (int i=0, n=nearby(sx - SNAP, sy - SNAP, c->w + bw + 2*SNAP, c->h + bw + 2*SNAP); i<n; i++) {
+        client *t = nearbyfound[i];
+        if (t == c || t->isfullscrn) continue;
+        int tx[2] = { t->x + t->w + bw, t->x - c->w - bw }, ty[2] = { t->y + t->h + bw, t->y - c->h - bw };
+        for (int j=0; j<2; j++) {
+            if (abs(tx[j] - sx) < abs(bx)) bx = tx[j] - sx;
+            if (abs(ty[j] - sy) < abs(by)) by = ty[j] - sy;
+        }
+    }
+    if (abs(bx) <= SNAP) *x += bx;
+    if (abs(by) <= SNAP) *y += by;
+}
+
+/* execute a command
+ * the command is given a startup id in DESKTOP_STARTUP_ID, and its first
+ * window is placed on the desktop it was launched from, see launchdesktop() */
 void spawn(const Arg *arg) {
-    if (fork()) return;
-    if (dis) close(ConnectionNumber(dis));
+    launch *l = NULL;
+    for (int i=0; i<LAUNCHES && !l; i++) if (!launches[i].id[0]) l = &launches[i];
+    if (l) snprintf(l->id, sizeof l->id, "monsterwm-%ld-%lu_TIME%lu", (long)getpid(), ++launchseq, inputtime);
+    pid_t pid = fork();
+    if (pid && l && pid < 0) l->id[0] = '\0';
+    else if (pid && l) {
+        snprintf(l->cmd, sizeof l->cmd, "%s", arg->com[0]);
+        l->pid = pid; l->screen = cs; l->desktop = current_desktop; l->time = ustime();
+        nlaunches++;
+    }
+    if (pid) return;
+    if (dis) close(be->ConnectionNumber(dis));
     setsid();
+    if (l) setenv("DESKTOP_STARTUP_ID", l->id, 1);
     execvp((char*)arg->com[0], (char**)arg->com);
     err(EXIT_SUCCESS, "execvp %s", (char *)arg->com[0]);
 }
@@ -824,11 +2764,21 @@ void spawn(const Arg *arg) {
 /* arrange windows in normal or bottom stack tile */
 void stack(int hh, int cy) {
     client *c = NULL, *t = NULL; Bool b = mode == BSTACK;
-    int n = 0, d = 0, z = b ? ww:hh, ma = (mode == BSTACK ? wh:ww) * MASTER_SIZE + master_size;
+    int n = 0, d = 0, z = b ? ww:hh, ma = (mode == BSTACK ? wh:ww) * cfg->mastersize + master_size;
 
     /* count stack windows and grab first non-floating, non-fullscreen window */
     for (t = head; t; t=t->next) if (!ISFFT(t)) { if (c) ++n; else c = t; }
 
+    /* with more than STACK_SLOTS stack windows only a page of them is shown,
+     * scrolled so that the focused one is on it, the rest are hidden */
+    int k = -1, first = 0, shown = n;
+    if (STACK_SLOTS && n > STACK_SLOTS) {
+        for (t = c ? c->next:NULL; t && t != current; t=t->next) if (!ISFFT(t)) k++;
+        if (t && !ISFFT(t)) { if (++k < scroll) scroll = k; else if (k >= scroll + STACK_SLOTS) scroll = k - STACK_SLOTS + 1; }
+        if (scroll > n - STACK_SLOTS) scroll = n - STACK_SLOTS;
+        first = scroll; shown = STACK_SLOTS; k = -1;
+    }
+
     /* if there is only one window, it should cover the available screen space
      * if there is only one stack window (n == 1) then we don't care about growth
      * if more than one stack windows (n > 1) on screen then adjustments may be needed
@@ -853,27 +2803,49 @@ void stack(int hh, int cy) {
      *     finally we know each client's height, and how many pixels should be added to
      *     the first stack window so that it satisfies growth, and doesn't create gaps
      *     on the bottom of the screen.  */
-    if (!c) return; else if (!n) {
-        XMVRSZ(dis, c->win, 0, cy, ww - 2*BORDER_WIDTH, hh - 2*BORDER_WIDTH);
+    if (!c) return; else setpaged(c, False);
+    if (!n) {
+        resize(c, 0, cy, ww - 2*cfg->borderwidth, hh - 2*cfg->borderwidth);
         return;
-    } else if (n > 1) { d = (z - growth)%n + growth; z = (z - growth)/n; }
+    } else if (shown > 1) { d = (z - growth)%shown + growth; z = (z - growth)/shown; }
 
     /* tile the first non-floating, non-fullscreen window to cover the master area */
-    if (b) XMVRSZ(dis, c->win, 0, cy, ww - 2*BORDER_WIDTH, ma - BORDER_WIDTH);
-    else   XMVRSZ(dis, c->win, 0, cy, ma - BORDER_WIDTH, hh - 2*BORDER_WIDTH);
-
-    /* tile the next non-floating, non-fullscreen (first) stack window with growth|d */
-    for (c=c->next; c && ISFFT(c); c=c->next);
-    int cx = b ? 0:ma, cw = (b ? hh:ww) - 2*BORDER_WIDTH - ma, ch = z - BORDER_WIDTH;
-    if (b) XMVRSZ(dis, c->win, cx, cy += ma, ch - BORDER_WIDTH + d, cw);
-    else   XMVRSZ(dis, c->win, cx, cy, cw, ch - BORDER_WIDTH + d);
-
-    /* tile the rest of the non-floating, non-fullscreen stack windows */
-    for (b?(cx+=ch+d):(cy+=ch+d), c=c->next; c; c=c->next) {
+    if (b) resize(c, 0, cy, ww - 2*cfg->borderwidth, ma - cfg->borderwidth);
+    else   resize(c, 0, cy, ma - cfg->borderwidth, hh - 2*cfg->borderwidth);
+
+    /* tile the first non-floating, non-fullscreen stack window on the page
+     * with growth|d, then the rest of them, and hide those off the page */
+    int cx = b ? 0:ma, cw = (b ? hh:ww) - 2*cfg->borderwidth - ma, ch = z - cfg->borderwidth;
+    if (b) cy += ma;
+    for (c=c->next; c; c=c->next) {
         if (ISFFT(c)) continue;
-        if (b) { XMVRSZ(dis, c->win, cx, cy, ch, cw); cx += z; }
-        else   { XMVRSZ(dis, c->win, cx, cy, cw, ch); cy += z; }
+        if (++k < first || k >= first + shown) { setpaged(c, True); continue; }
+        setpaged(c, False);
+        if (k == first) {
+            if (b) { resize(c, cx, cy, ch - cfg->borderwidth + d, cw); cx += ch + d; }
+            else   { resize(c, cx, cy, cw, ch - cfg->borderwidth + d); cy += ch + d; }
+        } else if (b) { resize(c, cx, cy, ch, cw); cx += z; }
+        else          { resize(c, cx, cy, cw, ch); cy += z; }
+    }
+}
+
+/* swap the current window with the nearest window in the given direction
+ * floating windows trade places, tiled windows trade their position in the stack */
+void swap_dir(const Arg *arg) {
+    client *c = current, *n = neighbour(arg->i), **pc, **pn, *t;
+    if (!n) return;
+    if (ISFLT(c) && ISFLT(n)) {
+        int x = c->x, y = c->y;
+        resize(c, n->x, n->y, c->w, c->h);
+        resize(n, x, y, n->w, n->h);
+    } else if (!ISFFT(c) && !ISFFT(n)) {
+        for (pc=&head; *pc != c; pc=&(*pc)->next);
+        for (pn=&head; *pn != n; pn=&(*pn)->next);
+        t = *pc; *pc = *pn; *pn = t;
+        t = c->next; c->next = n->next; n->next = t;
+        tile();
     }
+    update_current(c);
 }
 
 /* swap master window with current or
@@ -888,6 +2860,59 @@ void swap_master(void) {
     update_current(head);
 }
 
+/* output stats on standard error stream
+ *
+ * the info is a line of ':' separated values, the first value is the kind
+ *   throttled - for each client
+ *     the desktop number/id and the client's window id
+ *     the count of throttled hints, activation and configure events
+ *   latency - once, for all events handled since the start
+ *     the count of events and the 50th, 90th, 99th percentile
+ *     and maximum handling time in microseconds
+ *   input - for each bound function that was called
+ *     the function's name, the count of calls and the 50th, 90th, 99th
+ *     percentile and maximum time in microseconds, with millisecond
+ *     precision, from the key or button press to the server having
+ *     processed the function's requests, both in server time
+ *   scratch - once
+ *     the size and peak use of the scratch arena in bytes, and how
+ *     many allocations did not fit in it and went to the heap
+ *   sample - every SAMPLE_INTERVAL seconds, see sample()
+ *     the uptime in seconds, the resident memory and the heap in use
+ *     in kilobytes, the heap being 0 on C libraries before glibc 2.33
+ *     the count of managed, ever allocated and freed clients
+ *     the count of events, 50th, 99th percentile and maximum handling
+ *     time in microseconds, in the interval */
+void stats(void) {
+    int sc = cs, cd;
+    dumpstats = 0;
+    for (int s=0; s<nscreens; s++) {
+        select_screen(s);
+        cd = current_desktop;
+        for (int d=0; d<DESKTOPS; d++) for (client *c=(select_desktop(d), head); c; c=c->next)
+            fprintf(stderr, "throttled:%d:0x%lx:%u:%u:%u\n", s*DESKTOPS + d, c->win, c->throttled[EV_HINTS],
+                            c->throttled[EV_ACTIVE], c->throttled[EV_CONFIG]);
+        select_desktop(cd);
+    }
+    fprintf(stderr, "latency:%lu:%ld:%ld:%ld:%lu\n", evlatency.n, percentile(&evlatency, 50),
+            percentile(&evlatency, 90), percentile(&evlatency, 99), evlatency.max);
+    for (unsigned int i=0; i<LENGTH(bindings); i++) if (inputlatency[i].n)
+        fprintf(stderr, "input:%s:%lu:%ld:%ld:%ld:%lu\n", bindingnames[i], inputlatency[i].n,
+                percentile(&inputlatency[i], 50), percentile(&inputlatency[i], 90),
+                percentile(&inputlatency[i], 99), inputlatency[i].max);
+    for (int i=0; i<LAUNCHES && launchstats[i].cmd[0]; i++) {
+        histogram *h = &launchstats[i].latency;
+        fprintf(stderr, "launch:%s:%lu:%ld:%ld:%ld:%lu:%lu\n", launchstats[i].cmd, h->n, percentile(h, 50),
+                percentile(h, 90), percentile(h, 99), h->max, launchstats[i].expired);
+    }
+    long up = mstime() - started;
+    fprintf(stderr, "wakeups:%lu:%lu\n", wakeups, up > 0 ? wakeups*1000/up:0);
+    fprintf(stderr, "scratch:%lu:%lu:%lu\n", (unsigned long)arena.size, (unsigned long)arena.peak, arena.spills);
+    if (stalllog) fprintf(stderr, "stalls:%lu:%lu:%lu\n", loop.stalls, loop.stalled, loop.longest);
+    fflush(stderr);
+    select_screen(sc);
+}
+
 /* switch the tiling mode and reset all floating windows */
 void switch_mode(const Arg *arg) {
     if (mode == arg->i) for (client *c=head; c; c=c->next) c->isfloating = False;
@@ -896,11 +2921,67 @@ void switch_mode(const Arg *arg) {
     desktopinfo();
 }
 
-/* tile all windows of current desktop - call the handler tiling function */
+/* tile all windows of current desktop - call the handler tiling function
+ * inside a batch the desktop is only marked to be tiled on commit */
 void tile(void) {
+    if (batch) { touched |= 1 << current_desktop; return; }
+    stale &= ~(1 << current_desktop);
+    /* only the stack layouts page windows, show them again for the others */
+    for (client *c=head; c; c=c->next) if (c->paged && (ISFFT(c) || !head->next || (mode != TILE && mode != BSTACK)))
+        setpaged(c, False);
     if (!head || mode == FLOAT) return; /* nothing to arange */
+    PROBE(tile__entry, head->win);
     layout[head->next ? mode:MONOCLE](wh + (showpanel ? 0:PANEL_HEIGHT),
                               (TOP_PANEL && showpanel ? PANEL_HEIGHT:0));
+    PROBE(tile__exit, head->win);
+}
+
+/* take a token from the client's bucket of the given event class
+ * if the bucket is empty the event is over budget, so it is counted, and
+ * marked for a trailing update instead of being handled right away */
+Bool throttle(client *c, int ev) {
+    long now = mstime();
+    c->tokens[ev] += (now - c->stamp[ev]) * EVENT_RATE / 1000.0;
+    if (c->tokens[ev] > EVENT_BURST) c->tokens[ev] = EVENT_BURST;
+    c->stamp[ev] = now;
+    if (!(c->deferred & 1 << ev) && c->tokens[ev] >= 1) { c->tokens[ev]--; return False; }
+    c->throttled[ev]++;
+    c->deferred |= 1 << ev;
+    if (!deferred) deadline = now + 1000/EVENT_RATE;
+    return (deferred = True);
+}
+
+/* milliseconds until the nearest pending deadline, or -1 if there is none */
+long timeout(void) {
+    long at = 0, now = mstime();
+    if (deferred) at = deadline;
+    if (batch && (!at || batchend < at)) at = batchend;
+    if (SAMPLE_INTERVAL && (!at || nextsample < at)) at = nextsample;
+    if (titledue && (!at || titledue < at)) at = titledue;
+    return !at ? -1 : at > now ? at - now:0;
+}
+
+/* show or hide the focused window on the given desktop too
+ * a window that is left only on its own desktop is no longer tagged */
+void toggle_tag(const Arg *arg) {
+    if (!current || arg->i < 0 || arg->i >= DESKTOPS || arg->i == current_desktop) return;
+    unsigned int tags = (current->tags ? current->tags:1U << current_desktop) ^ 1U << arg->i;
+    current->desktop = current_desktop;
+    settags(current, tags == 1U << current_desktop ? 0:tags);
+}
+
+/* time the requests the bound function made for the input at server time t
+ * an empty append to a property of the root window is processed after them,
+ * and the server stamps the resulting PropertyNotify, which is matched back
+ * to the input in order. functions that are not BINDABLE are not timed */
+void stamp(void (*func)(const Arg *), Time t) {
+    unsigned int fn = 0;
+    while (fn < LENGTH(bindings) && bindings[fn] != func) fn++;
+    if (fn == LENGTH(bindings) || nstamps == STAMPS || !running) return;
+    stamps[(firststamp + nstamps++) % STAMPS] = (inputstamp){ fn, t };
+    if (!(stamping & 1 << cs)) be->SelectInput(dis, root, ROOTMASK|PropertyChangeMask);
+    stamping |= 1 << cs;
+    be->ChangeProperty(dis, root, stampatom, XA_INTEGER, 32, PropModeAppend, (unsigned char *)"", 0);
 }
 
 /* toggle visibility state of the panel */
@@ -910,13 +2991,86 @@ void togglepanel(void) {
 }
 
 /* windows that request to unmap should lose their
- * client, so no invisible windows exist on screen */
+ * client, so no invisible windows exist on screen
+ *
+ * the wm only unmaps the containers, and stack windows scrolled off the
+ * page, whose unmaps are counted like the ones caused by reparenting.
+ * any other unmap means the window is withdrawn.
+ * a withdrawn window is given back to the root window */
 void unmapnotify(XEvent *e) {
     client *c = wintoclient(e->xunmap.window);
-    if (c && e->xunmap.send_event) removeclient(c);
+    if (c && !e->xunmap.send_event && c->unmaps > 0) { c->unmaps--; return; }
+    if (c) {
+        openburst();
+        be->ReparentWindow(dis, c->win, root, c->x, c->y);
+        be->RemoveFromSaveSet(dis, c->win);
+        removeclient(c);
+    }
     desktopinfo();
 }
 
+/* check whether the window has set the urgency hint */
+Bool urgenthint(Window w) {
+    XWMHints *wmh = be->GetWMHints(dis, w);
+    Bool urgent = wmh && (wmh->flags & XUrgencyHint);
+    if (wmh) XFree(wmh);
+    return urgent;
+}
+
+/* monotonic time in microseconds */
+long ustime(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* watch the main loop's heartbeat, and when it has not moved for over
+ * STALL_TIMEOUT milliseconds while the loop is busy, log what the loop is
+ * doing, the last request sent and the last one the server processed, and
+ * a stack sample taken by the main thread itself. the end of the stall is
+ * logged with its duration and the count and duration of all stalls.
+ * the request numbers are read without the display lock, they are only
+ * counters so a stale read is harmless */
+void* watchdog(void *unused) {
+    (void)unused;
+    if (!STALL_TIMEOUT) return NULL;
+    unsigned long beat = loop.heartbeat;
+    long since = mstime(), now;
+    Bool stalled = False;
+    struct timespec tick = { STALL_TIMEOUT/4/1000, STALL_TIMEOUT/4%1000*1000000L };
+    for (;;) {
+        nanosleep(&tick, NULL);
+        now = mstime();
+        if (beat != loop.heartbeat || !loop.busy) {
+            if (stalled) {
+                unsigned long d = now - since;
+                loop.stalls++; loop.stalled += d;
+                if (d > loop.longest) loop.longest = d;
+                fprintf(stalllog, "end:%ld:%lu:%lu:%lu:%lu\n", (now - started)/1000, d,
+                        loop.stalls, loop.stalled, loop.longest);
+                fflush(stalllog);
+            }
+            beat = loop.heartbeat; since = now; stalled = False;
+        } else if (!stalled && now - since >= STALL_TIMEOUT) {
+            stalled = True;
+            fprintf(stalllog, "stall:%ld:%s:%d:0x%lx:%lu:%lu\n", (since - started)/1000, loop.phase,
+                    loop.type, loop.win, NextRequest(dis) - 1, LastKnownRequestProcessed(dis));
+            fflush(stalllog);
+            pthread_kill(mainthread, SIGUSR2);
+        }
+    }
+    return NULL;
+}
+
+/* remove the client from the grid cells it is indexed in */
+void unindex(client *c) {
+    for (int i=c->gx; i<c->gx + c->gw; i++) for (int j=c->gy; j<c->gy + c->gh; j++) {
+        cell *l = &c->cells[j*GRID_CELLS + i];
+        for (int k=0; k<l->n; k++) if (l->c[k] == c) { l->c[k] = l->c[--l->n]; break; }
+    }
+    c->gw = c->gh = 0;
+}
+
 /* highlight borders and set active window and input focus
  * if given current is NULL then delete the active window property
  *
@@ -931,46 +3085,66 @@ void unmapnotify(XEvent *e) {
  * a window should have borders in any case, except if
  *  - the window is the only window on screen
  *  - the window is fullscreen
- *  - the mode is MONOCLE and the window is not floating or transient */
+ *  - the mode is MONOCLE and the window is not floating or transient
+ *
+ * the client moves to the front of the desktop's focus history, and of all
+ * desktops' history if the desktop is shown and no cycling is going on.
+ * inside a batch only current and the history are updated, and the
+ * desktop is marked to be restacked and focused on commit */
 void update_current(client *c) {
     if (!head) {
-        XDeleteProperty(dis, root, netatoms[NET_ACTIVE]);
-        current = prevfocus = NULL;
+        current = NULL;
+        if (batch) { touched |= 1 << current_desktop; return; }
+        be->DeleteProperty(dis, root, netatoms[NET_ACTIVE]);
+        dirty = True;
         return;
-    } else if (c == prevfocus) { prevfocus = prev_client(current = prevfocus ? prevfocus:head);
-    } else if (c != current) { prevfocus = current; current = c; }
-
-    /* num of n:all fl:fullscreen ft:floating/transient windows */
+    }
+    remember((current = c ? c:head));
+    if (!cycling && current_desktop == visible) promote(current);
+    if (batch) { touched |= 1 << current_desktop; return; }
+    PROBE(update_current__entry, current->win);
+    if (current->paged) tile(); /* scroll the focused window onto the page */
+
+    /* num of n:all fl:fullscreen ft:floating/transient windows
+     * the restack array is scratch memory, released right after use */
     int n = 0, fl = 0, ft = 0;
     for (c = head; c; c = c->next, ++n) if (ISFFT(c)) { fl++; if (!c->isfullscrn) ft++; }
-    Window w[n];
+    size_t top = arena.used;
+    int nw = n;
+    Window *w = scratch(n*sizeof(Window));
     w[(current->isfloating||current->istransient) ? 0:ft] = current->win;
     for (fl += !ISFFT(current) ? 1:0, c = head; c; c = c->next) {
-        XSetWindowBorder(dis, c->win, c == current ? win_focus:win_unfocus);
-        XSetWindowBorderWidth(dis, c->win, (!head->next || c->isfullscrn
-                    || (mode == MONOCLE && !ISFFT(c))) ? 0:BORDER_WIDTH);
+        selectmask(c, current_desktop == visible && !c->paged && (c == current || ISFFT(c) || mode != MONOCLE));
+        be->SetWindowBorder(dis, c->win, c == current ? win_focus:win_unfocus);
+        be->SetWindowBorderWidth(dis, c->win, (!head->next || c->isfullscrn
+                    || (mode == MONOCLE && !ISFFT(c))) ? 0:cfg->borderwidth);
         if (c != current) w[c->isfullscrn ? --fl:ISFFT(c) ? --ft:--n] = c->win;
-        if (CLICK_TO_FOCUS) XGrabButton(dis, Button1, None, c->win, True,
+        if (CLICK_TO_FOCUS) be->GrabButton(dis, Button1, None, c->win, True,
                ButtonPressMask, GrabModeAsync, GrabModeAsync, None, None);
     }
-    XRestackWindows(dis, w, LENGTH(w));
+    be->RestackWindows(dis, w, nw);
+    arena.used = top;
+    if (current->isfullscrn) be->RaiseWindow(dis, container); else be->LowerWindow(dis, container);
 
-    XSetInputFocus(dis, current->win, RevertToPointerRoot, CurrentTime);
-    XChangeProperty(dis, root, netatoms[NET_ACTIVE], XA_WINDOW, 32,
+    be->SetInputFocus(dis, current->win, RevertToPointerRoot, CurrentTime);
+    be->ChangeProperty(dis, root, netatoms[NET_ACTIVE], XA_WINDOW, 32,
                 PropModeReplace, (unsigned char *)&current->win, 1);
-    if (CLICK_TO_FOCUS) XUngrabButton(dis, Button1, None, current->win);
+    dirty = True;
+    if (CLICK_TO_FOCUS) be->UngrabButton(dis, Button1, None, current->win);
 
-    XSync(dis, False);
+    PROBE(xsync__entry, current->win);
+    be->Sync(dis, False);
+    PROBE(xsync__exit, current->win);
+    PROBE(update_current__exit, current->win);
 }
 
-/* find to which client the given window belongs to */
+/* find to which client the given window belongs to, through its context */
 client* wintoclient(Window w) {
-    client *c = NULL;
-    int d = 0, cd = current_desktop;
-    for (Bool found = False; d<DESKTOPS && !found; ++d)
-        for (select_desktop(d), c=head; c && !(found = (w == c->win)); c=c->next);
-    if (cd != d-1) select_desktop(cd);
-    return c;
+    XPointer c = NULL;
+    PROBE(wintoclient__entry, w);
+    be->FindContext(dis, w, clientctx, &c);
+    PROBE(wintoclient__exit, w);
+    return (client *)c;
 }
 
 /* There's no way to check accesses to destroyed windows, thus those cases are
@@ -991,15 +3165,690 @@ int xerrorstart(void) {
     err(EXIT_FAILURE, "another window manager is already running");
 }
 
+#ifdef XINPUT2
+/* start a drag for mousemotion() without an active grab, so other clients
+ * keep getting the pointer's events. the raw motion and button release of
+ * the client pointer are followed on the root window instead */
+Bool xidragstart(int how) {
+    XIButtonState bs; XIModifierState ms; XIGroupState gs; double x, y, d; Window w;
+    if (!XIGetClientPointer(dis, None, &moving.dev)) return False;
+    be->UngrabPointer(dis, CurrentTime); /* the grab the button press activated */
+    if (how == RESIZE) XIWarpPointer(dis, moving.dev, None, current->win, 0, 0, 0, 0,
+                                     moving.wa.width, moving.wa.height);
+    if (!XIQueryPointer(dis, moving.dev, root, &w, &w, &x, &y, &d, &d, &bs, &ms, &gs)) return False;
+    free(bs.mask);
+    moving.rx = x; moving.ry = y;
+    xiselect(root, XI_RawMotionMask|XI_RawButtonReleaseMask);
+    return True;
+}
+
+/* an XInput2 event, the pointer entering a window focuses it like
+ * enternotify() does, whichever master pointer it was. the raw events of
+ * the dragging pointer carry on the drag like motionnotify() and
+ * buttonrelease() do */
+void xievent(XEvent *e) {
+    XPointer p;
+    if (e->xcookie.extension != xiopcode || !XGetEventData(dis, &e->xcookie)) return;
+    XIRawEvent *re = e->xcookie.data;
+    if (moving.c && re->deviceid == moving.dev && re->evtype == XI_RawMotion) moving.moved = True;
+    if (moving.c && re->deviceid == moving.dev && re->evtype == XI_RawButtonRelease) {
+        dragmove();
+        enddrag(False);
+    }
+    XIEnterEvent *ev = e->xcookie.data;
+    client *c = ev->evtype == XI_Enter ? wintoclient(ev->event):NULL;
+    if (c && nscreens > 1 && !be->FindContext(dis, ev->event, screenctx, &p)) select_screen((intptr_t)p);
+    if (c && ev->mode == XINotifyNormal && ev->detail != XINotifyInferior) update_current(c);
+    XFreeEventData(dis, &e->xcookie);
+}
+
+/* select the given XI_*Mask events of all master devices on the window */
+void xiselect(Window w, unsigned int events) {
+    unsigned char mask[XIMaskLen(XI_RawButtonRelease)] = { 0 };
+    for (unsigned int i=0; i<8*sizeof mask; i++) if (events & 1U << i) XISetMask(mask, i);
+    XISelectEvents(dis, w, &(XIEventMask){ XIAllMasterDevices, sizeof mask, mask }, 1);
+}
+#endif /* XINPUT2 */
+
+#ifdef MOCK
+/* the mock backend, an in memory model of the windows the handlers touch.
+ * it answers their requests without a server, and counts each of them, so
+ * benchmarks drive the real handlers deterministically. windows come into
+ * being on first use, unmapped, without a parent and of no size, atoms are
+ * interned locally and keys and colors are made up from their names.
+ * there is no display, so the mock keeps the contexts itself */
+
+/* the root window of the only mock screen, and the screen's size */
+#define MOCK_ROOT       1
+#define MOCK_WIDTH      1920
+#define MOCK_HEIGHT     1080
+
+/* a property of a mock window, its data as Xlib returns it, so format 32
+ * items are longs */
+typedef struct mockprop {
+    Atom name, type;
+    int format, n;
+    unsigned char *data;
+    struct mockprop *next;
+} mockprop;
+
+/* a mock window
+ * parent         - the window it is a child of
+ * x, y, w, h, bw - its geometry and border width
+ * border         - its border color
+ * mask           - the events it is selected for
+ * stack          - its place in the stacking order, higher is above
+ * mapped         - whether it is mapped
+ * saved          - whether it is in the save set
+ * props          - its properties */
+typedef struct {
+    Window parent;
+    int x, y, w, h, bw;
+    unsigned long border;
+    long mask, stack;
+    Bool mapped, saved;
+    mockprop *props;
+} mockwin;
+
+/* the data saved on a window under a context, chained in its bucket */
+typedef struct mockcontext {
+    XID w;
+    XContext ctx;
+    XPointer data;
+    struct mockcontext *next;
+} mockcontext;
+
+#define OPINDEX(f)      OP_##f,
+enum { BACKEND(OPINDEX) OP_COUNT };
+static const char *opnames[] = { BACKEND(NAME) };
+static unsigned long ops[OP_COUNT];
+static XContext mockctx;
+static Window mockfocus = None, mocknext = MOCK_ROOT;
+static long mocktop = 0, mockbottom = 0;
+/* where the pointer is on the mock screen */
+static int mockx = 0, mocky = 0;
+/* every mock window in the order they came into being, and the atom names */
+static Window *mockwins = NULL;
+static char **mockatoms = NULL;
+static int nmockwins = 0, mocksize = 0, nmockatoms = 0;
+/* the saved contexts, hashed on the window and context into a power of two
+ * buckets, doubled once there are as many contexts as buckets */
+static mockcontext **mockcontexts = NULL;
+static unsigned long nmockcontexts = 0, mockbuckets = 0;
+
+/* double the buckets and chain every context into its new one */
+static void mockrehash(void) {
+    mockcontext **old = mockcontexts;
+    unsigned long n = mockbuckets;
+    if (!(mockcontexts = calloc((mockbuckets = n ? 2*n:64), sizeof(mockcontext *))))
+        err(EXIT_FAILURE, "cannot allocate mock contexts");
+    for (unsigned long i=0; i<n; i++) for (mockcontext *c = old[i], *next; c; c = next) {
+        mockcontext **b = &mockcontexts[(c->w*31 + c->ctx) & (mockbuckets - 1)];
+        next = c->next; c->next = *b; *b = c;
+    }
+    free(old);
+}
+
+/* the link to the window's context, or to where it would be added */
+static mockcontext** mocklookup(XID w, XContext ctx) {
+    if (!mockbuckets) mockrehash();
+    mockcontext **l = &mockcontexts[(w*31 + ctx) & (mockbuckets - 1)];
+    while (*l && ((*l)->w != w || (*l)->ctx != ctx)) l = &(*l)->next;
+    return l;
+}
+
+/* save the data on the window under the context, replacing what was there */
+static void mocksave(XID w, XContext ctx, XPointer data) {
+    if (nmockcontexts >= mockbuckets) mockrehash();
+    mockcontext **l = mocklookup(w, ctx);
+    if (!*l) {
+        if (!(*l = calloc(1, sizeof(mockcontext)))) err(EXIT_FAILURE, "cannot allocate mock context");
+        (*l)->w = w; (*l)->ctx = ctx;
+        nmockcontexts++;
+    }
+    (*l)->data = data;
+}
+
+/* the model of the window, made on first use */
+static mockwin* mockwindow(Window w) {
+    if (!mockctx) mockctx = XUniqueContext();
+    mockcontext *c = *mocklookup(w, mockctx);
+    if (c) return (mockwin *)c->data;
+    mockwin *m = calloc(1, sizeof(mockwin));
+    if (!m || (nmockwins == mocksize && !(mockwins = realloc(mockwins, (mocksize = 2*mocksize + 4)*sizeof(Window)))))
+        err(EXIT_FAILURE, "cannot allocate mock window");
+    mockwins[nmockwins++] = w;
+    mocksave(w, mockctx, (XPointer)m);
+    return m;
+}
+
+/* the link to the window's property, or to where it would be added */
+static mockprop** mockproperty(Window w, Atom a) {
+    mockprop **p = &mockwindow(w)->props;
+    while (*p && (*p)->name != a) p = &(*p)->next;
+    return p;
+}
+
+/* a copy of the property's data, nul terminated, freed with XFree */
+static unsigned char* mockcopy(const mockprop *p) {
+    size_t n = p->n * (p->format == 32 ? sizeof(long):(size_t)p->format/8);
+    unsigned char *d = malloc(n + 1);
+    if (!d) err(EXIT_FAILURE, "cannot allocate mock property");
+    memcpy(d, p->data, n); d[n] = '\0';
+    return d;
+}
+
+static int mockAddToSaveSet(Display *d, Window w) {
+    (void)d; ops[OP_AddToSaveSet]++;
+    mockwindow(w)->saved = True;
+    return 1;
+}
+
+static Status mockAllocNamedColor(Display *d, Colormap map, const char *name, XColor *screen, XColor *exact) {
+    (void)d; (void)map; ops[OP_AllocNamedColor]++;
+    unsigned long pixel = 0;
+    while (*name) pixel = (pixel*31 + (unsigned char)*name++) & 0xffffff;
+    screen->pixel = exact->pixel = pixel;
+    return 1;
+}
+
+static int mockChangeProperty(Display *d, Window w, Atom a, Atom type, int format, int mode,
+                              const unsigned char *data, int n) {
+    (void)d; ops[OP_ChangeProperty]++;
+    mockprop **l = mockproperty(w, a), *p = *l;
+    size_t size = format == 32 ? sizeof(long):(size_t)format/8, old = 0;
+    if (!p && !(p = *l = calloc(1, sizeof(mockprop)))) err(EXIT_FAILURE, "cannot allocate mock property");
+    if (mode == PropModeReplace || p->type != type || p->format != format) p->n = 0;
+    else old = p->n * size;
+    if (!(p->data = realloc(p->data, old + n*size + 1))) err(EXIT_FAILURE, "cannot allocate mock property");
+    if (mode == PropModePrepend) memmove(p->data + n*size, p->data, old);
+    if (n) memcpy(p->data + (mode == PropModePrepend ? 0:old), data, n*size);
+    p->name = a; p->type = type; p->format = format; p->n += n;
+    return 1;
+}
+
+static int mockConfigureWindow(Display *d, Window w, unsigned int mask, XWindowChanges *wc) {
+    (void)d; ops[OP_ConfigureWindow]++;
+    mockwin *m = mockwindow(w);
+    if (mask & CWX) m->x = wc->x;
+    if (mask & CWY) m->y = wc->y;
+    if (mask & CWWidth) m->w = wc->width;
+    if (mask & CWHeight) m->h = wc->height;
+    if (mask & CWBorderWidth) m->bw = wc->border_width;
+    if (mask & CWStackMode) m->stack = wc->stack_mode == Below ? --mockbottom:++mocktop;
+    return 1;
+}
+
+/* there is no connection to poll */
+static int mockConnectionNumber(Display *d) {
+    (void)d; ops[OP_ConnectionNumber]++;
+    return -1;
+}
+
+static Window mockCreateWindow(Display *d, Window parent, int x, int y, unsigned int width, unsigned int height,
+                               unsigned int bw, int depth, unsigned int class, Visual *visual,
+                               unsigned long mask, XSetWindowAttributes *attrs) {
+    (void)d; (void)depth; (void)class; (void)visual; ops[OP_CreateWindow]++;
+    mockwin *m = mockwindow(++mocknext);
+    m->parent = parent; m->x = x; m->y = y; m->w = width; m->h = height; m->bw = bw;
+    if (mask & CWEventMask) m->mask = attrs->event_mask;
+    return mocknext;
+}
+
+static Colormap mockDefaultColormap(Display *d, int screen) {
+    (void)d; (void)screen; ops[OP_DefaultColormap]++;
+    return None;
+}
+
+static int mockDefaultScreen(Display *d) {
+    (void)d; ops[OP_DefaultScreen]++;
+    return 0;
+}
+
+static int mockDeleteContext(Display *d, XID w, XContext ctx) {
+    (void)d; ops[OP_DeleteContext]++;
+    mockcontext **l = mocklookup(w, ctx), *c = *l;
+    if (!c) return XCNOENT;
+    *l = c->next; free(c);
+    nmockcontexts--;
+    return 0;
+}
+
+static int mockDeleteProperty(Display *d, Window w, Atom a) {
+    (void)d; ops[OP_DeleteProperty]++;
+    mockprop **l = mockproperty(w, a), *p = *l;
+    if (p) { *l = p->next; free(p->data); free(p); }
+    return 1;
+}
+
+static int mockDisplayHeight(Display *d, int screen) {
+    (void)d; (void)screen; ops[OP_DisplayHeight]++;
+    return MOCK_HEIGHT;
+}
+
+static int mockDisplayWidth(Display *d, int screen) {
+    (void)d; (void)screen; ops[OP_DisplayWidth]++;
+    return MOCK_WIDTH;
+}
+
+static int mockFindContext(Display *d, XID w, XContext ctx, XPointer *data) {
+    (void)d; ops[OP_FindContext]++;
+    mockcontext *c = *mocklookup(w, ctx);
+    if (!c) return XCNOENT;
+    *data = c->data;
+    return 0;
+}
+
+static int mockGetClassHint(Display *d, Window w, XClassHint *ch) {
+    (void)d; ops[OP_GetClassHint]++;
+    mockprop *p = *mockproperty(w, XA_WM_CLASS);
+    if (!p) return 0;
+    ch->res_name = (char *)mockcopy(p);
+    ch->res_class = strdup(ch->res_name + strlen(ch->res_name) + (strlen(ch->res_name) < (size_t)p->n));
+    return 1;
+}
+
+static XModifierKeymap* mockGetModifierMapping(Display *d) {
+    (void)d; ops[OP_GetModifierMapping]++;
+    return XNewModifiermap(0);
+}
+
+static Status mockGetTextProperty(Display *d, Window w, XTextProperty *tp, Atom a) {
+    (void)d; ops[OP_GetTextProperty]++;
+    mockprop *p = *mockproperty(w, a);
+    if (!p) return 0;
+    *tp = (XTextProperty){ mockcopy(p), p->type, p->format, p->n };
+    return 1;
+}
+
+static Status mockGetTransientForHint(Display *d, Window w, Window *t) {
+    (void)d; ops[OP_GetTransientForHint]++;
+    mockprop *p = *mockproperty(w, XA_WM_TRANSIENT_FOR);
+    if (!p || p->format != 32 || !p->n) return 0;
+    *t = *(long *)p->data;
+    return 1;
+}
+
+/* only the flags of the hints are modelled */
+static XWMHints* mockGetWMHints(Display *d, Window w) {
+    (void)d; ops[OP_GetWMHints]++;
+    mockprop *p = *mockproperty(w, XA_WM_HINTS);
+    XWMHints *h = p && p->format == 32 && p->n ? calloc(1, sizeof(XWMHints)):NULL;
+    if (h) h->flags = *(long *)p->data;
+    return h;
+}
+
+/* no window has size hints */
+static Status mockGetWMNormalHints(Display *d, Window w, XSizeHints *h, long *supplied) {
+    (void)d; (void)w; (void)h; ops[OP_GetWMNormalHints]++;
+    *supplied = 0;
+    return 0;
+}
+
+static Status mockGetWMProtocols(Display *d, Window w, Atom **protocols, int *n) {
+    (void)d; ops[OP_GetWMProtocols]++;
+    mockprop *p = *mockproperty(w, wmatoms[WM_PROTOCOLS]);
+    if (!p || p->format != 32) return 0;
+    if (!(*protocols = malloc(p->n*sizeof(Atom) + 1))) err(EXIT_FAILURE, "cannot allocate mock property");
+    for (int i=0; i<p->n; i++) (*protocols)[i] = ((long *)p->data)[i];
+    *n = p->n;
+    return 1;
+}
+
+static Status mockGetWindowAttributes(Display *d, Window w, XWindowAttributes *wa) {
+    (void)d; ops[OP_GetWindowAttributes]++;
+    mockwin *m = mockwindow(w);
+    *wa = (XWindowAttributes){ .x = m->x, .y = m->y, .width = m->w, .height = m->h, .border_width = m->bw,
+            .root = root, .your_event_mask = m->mask, .map_state = m->mapped ? IsViewable:IsUnmapped };
+    return 1;
+}
+
+/* the offset is ignored, the handlers read properties from their start */
+static int mockGetWindowProperty(Display *d, Window w, Atom a, long offset, long length, Bool delete,
+                                 Atom req, Atom *type, int *format, unsigned long *n,
+                                 unsigned long *after, unsigned char **data) {
+    (void)d; (void)offset; ops[OP_GetWindowProperty]++;
+    mockprop *p = *mockproperty(w, a);
+    *type = p ? p->type:None; *format = p ? p->format:0; *n = *after = 0; *data = NULL;
+    if (!p || (req != AnyPropertyType && req != p->type)) return Success;
+    *n = p->n < length ? p->n:length; *after = p->n - *n;
+    *data = mockcopy(p);
+    if (delete) mockDeleteProperty(d, w, a);
+    return Success;
+}
+
+static int mockGrabButton(Display *d, unsigned int button, unsigned int mods, Window w, Bool owner,
+                          unsigned int mask, int pointer, int keyboard, Window confine, Cursor cursor) {
+    (void)d; (void)button; (void)mods; (void)w; (void)owner; (void)mask; (void)pointer;
+    (void)keyboard; (void)confine; (void)cursor; ops[OP_GrabButton]++;
+    return 1;
+}
+
+static int mockGrabKey(Display *d, int key, unsigned int mods, Window w, Bool owner, int pointer, int keyboard) {
+    (void)d; (void)key; (void)mods; (void)w; (void)owner; (void)pointer; (void)keyboard; ops[OP_GrabKey]++;
+    return 1;
+}
+
+static int mockGrabKeyboard(Display *d, Window w, Bool owner, int pointer, int keyboard, Time t) {
+    (void)d; (void)w; (void)owner; (void)pointer; (void)keyboard; (void)t; ops[OP_GrabKeyboard]++;
+    return GrabSuccess;
+}
+
+static int mockGrabPointer(Display *d, Window w, Bool owner, unsigned int mask, int pointer, int keyboard,
+                           Window confine, Cursor cursor, Time t) {
+    (void)d; (void)w; (void)owner; (void)mask; (void)pointer; (void)keyboard; (void)confine;
+    (void)cursor; (void)t; ops[OP_GrabPointer]++;
+    return GrabSuccess;
+}
+
+static Atom mockInternAtom(Display *d, const char *name, Bool existing) {
+    (void)d; ops[OP_InternAtom]++;
+    int i = 0;
+    while (i < nmockatoms && strcmp(mockatoms[i], name)) i++;
+    if (i == nmockatoms) {
+        if (existing) return None;
+        if (!(mockatoms = realloc(mockatoms, (nmockatoms + 1)*sizeof(char *)))
+         || !(mockatoms[nmockatoms++] = strdup(name))) err(EXIT_FAILURE, "cannot allocate mock atom");
+    }
+    return XA_LAST_PREDEFINED + 1 + i;
+}
+
+static KeyCode mockKeysymToKeycode(Display *d, KeySym k) {
+    (void)d; ops[OP_KeysymToKeycode]++;
+    return 8 + k % 248;
+}
+
+static int mockKillClient(Display *d, XID w) {
+    (void)d; ops[OP_KillClient]++;
+    mockwindow(w)->mapped = False;
+    return 1;
+}
+
+static int mockLowerWindow(Display *d, Window w) {
+    (void)d; ops[OP_LowerWindow]++;
+    mockwindow(w)->stack = --mockbottom;
+    return 1;
+}
+
+static int mockMapWindow(Display *d, Window w) {
+    (void)d; ops[OP_MapWindow]++;
+    mockwindow(w)->mapped = True;
+    return 1;
+}
+
+static int mockMoveResizeWindow(Display *d, Window w, int x, int y, unsigned int width, unsigned int height) {
+    (void)d; ops[OP_MoveResizeWindow]++;
+    mockwin *m = mockwindow(w);
+    m->x = x; m->y = y; m->w = width; m->h = height;
+    return 1;
+}
+
+static Status mockParseColor(Display *d, Colormap map, const char *name, XColor *c) {
+    (void)d; (void)map; (void)name; (void)c; ops[OP_ParseColor]++;
+    return 1;
+}
+
+/* the pointer is over the root with no button held, children are not looked for */
+static Bool mockQueryPointer(Display *d, Window w, Window *root, Window *child, int *rx, int *ry,
+                             int *x, int *y, unsigned int *mask) {
+    (void)d; ops[OP_QueryPointer]++;
+    mockwin *m = mockwindow(w);
+    *root = MOCK_ROOT; *child = None; *mask = 0;
+    *rx = mockx; *ry = mocky; *x = mockx - m->x; *y = mocky - m->y;
+    return True;
+}
+
+/* the children in the order they came into being rather than stacked */
+static Status mockQueryTree(Display *d, Window w, Window *root, Window *parent, Window **children, unsigned int *n) {
+    (void)d; ops[OP_QueryTree]++;
+    *root = MOCK_ROOT; *parent = mockwindow(w)->parent; *children = NULL; *n = 0;
+    for (int i=0; i<nmockwins; i++) if (mockwindow(mockwins[i])->parent == w) {
+        if (!*n && !(*children = malloc(nmockwins*sizeof(Window)))) err(EXIT_FAILURE, "cannot allocate mock tree");
+        (*children)[(*n)++] = mockwins[i];
+    }
+    return 1;
+}
+
+static int mockRaiseWindow(Display *d, Window w) {
+    (void)d; ops[OP_RaiseWindow]++;
+    mockwindow(w)->stack = ++mocktop;
+    return 1;
+}
+
+static int mockRemoveFromSaveSet(Display *d, Window w) {
+    (void)d; ops[OP_RemoveFromSaveSet]++;
+    mockwindow(w)->saved = False;
+    return 1;
+}
+
+static int mockReparentWindow(Display *d, Window w, Window parent, int x, int y) {
+    (void)d; ops[OP_ReparentWindow]++;
+    mockwin *m = mockwindow(w);
+    m->parent = parent; m->x = x; m->y = y;
+    return 1;
+}
+
+/* the first window ends up on top */
+static int mockRestackWindows(Display *d, Window *w, int n) {
+    (void)d; ops[OP_RestackWindows]++;
+    for (int i=0; i<n; i++) mockwindow(w[i])->stack = mocktop + n - i;
+    mocktop += n;
+    return 1;
+}
+
+static Window mockRootWindow(Display *d, int screen) {
+    (void)d; (void)screen; ops[OP_RootWindow]++;
+    return MOCK_ROOT;
+}
+
+static int mockSaveContext(Display *d, XID w, XContext ctx, const char *data) {
+    (void)d; ops[OP_SaveContext]++;
+    mocksave(w, ctx, (XPointer)data);
+    return 0;
+}
+
+static int mockScreenCount(Display *d) {
+    (void)d; ops[OP_ScreenCount]++;
+    return 1;
+}
+
+static int mockSelectInput(Display *d, Window w, long mask) {
+    (void)d; ops[OP_SelectInput]++;
+    mockwindow(w)->mask = mask;
+    return 1;
+}
+
+static Status mockSendEvent(Display *d, Window w, Bool propagate, long mask, XEvent *ev) {
+    (void)d; (void)w; (void)propagate; (void)mask; (void)ev; ops[OP_SendEvent]++;
+    return 1;
+}
+
+static int mockSetInputFocus(Display *d, Window w, int revert, Time t) {
+    (void)d; (void)revert; (void)t; ops[OP_SetInputFocus]++;
+    mockfocus = w;
+    return 1;
+}
+
+static int mockSetWindowBorder(Display *d, Window w, unsigned long pixel) {
+    (void)d; ops[OP_SetWindowBorder]++;
+    mockwindow(w)->border = pixel;
+    return 1;
+}
+
+static int mockSetWindowBorderWidth(Display *d, Window w, unsigned int width) {
+    (void)d; ops[OP_SetWindowBorderWidth]++;
+    mockwindow(w)->bw = width;
+    return 1;
+}
+
+static int mockSync(Display *d, Bool discard) {
+    (void)d; (void)discard; ops[OP_Sync]++;
+    return 1;
+}
+
+static int mockUngrabButton(Display *d, unsigned int button, unsigned int mods, Window w) {
+    (void)d; (void)button; (void)mods; (void)w; ops[OP_UngrabButton]++;
+    return 1;
+}
+
+static int mockUngrabKey(Display *d, int key, unsigned int mods, Window w) {
+    (void)d; (void)key; (void)mods; (void)w; ops[OP_UngrabKey]++;
+    return 1;
+}
+
+static int mockUngrabKeyboard(Display *d, Time t) {
+    (void)d; (void)t; ops[OP_UngrabKeyboard]++;
+    return 1;
+}
+
+static int mockUngrabPointer(Display *d, Time t) {
+    (void)d; (void)t; ops[OP_UngrabPointer]++;
+    return 1;
+}
+
+static int mockUnmapWindow(Display *d, Window w) {
+    (void)d; ops[OP_UnmapWindow]++;
+    mockwindow(w)->mapped = False;
+    return 1;
+}
+
+/* relative to where the pointer is, or to the destination window, whose
+ * position is taken as on the root */
+static int mockWarpPointer(Display *d, Window src, Window dest, int sx, int sy, unsigned int sw, unsigned int sh,
+                           int x, int y) {
+    (void)d; (void)src; (void)sx; (void)sy; (void)sw; (void)sh; ops[OP_WarpPointer]++;
+    if (dest == None) { mockx += x; mocky += y; }
+    else { mockx = mockwindow(dest)->x + x; mocky = mockwindow(dest)->y + y; }
+    return 1;
+}
+
+#define MOCKOP(f)       .f = mock##f,
+static const backend mock = { BACKEND(MOCKOP) };
+
+/* the first window id handed out by bench() and soak() */
+#define BENCH_WINDOW    0x7f000000
+
+/* hand an event to its handler, recording its duration for the samples,
+ * then run the steps the main loop runs when it is idle */
+static void benchevent(XEvent *ev) {
+    long t = ustime();
+    events[ev->type](ev);
+    t = ustime() - t;
+    record(&evlatency, t);
+    record(&samplelatency, t);
+    if (burst) commit();
+    if (deferred) flushdeferred();
+    retitle(False);
+    if (dirty) publish();
+    scratchreset();
+    prelayout();
+}
+
+/* drive n windows through the real handlers against the mock backend, and
+ * print how many events were handled, in how many microseconds, and the
+ * requests they took. each window is mapped on the next desktop in turn,
+ * then every window is configured, retitled, activated and destroyed.
+ * the wm is stopped once done, so run() returns right away */
+static void bench(int n) {
+    XEvent ev;
+    unsigned long k = 0;
+    memset(ops, 0, sizeof ops);
+    long t = ustime();
+    for (int i=0; i<n; i++, k++) {
+        change_desktop(&(Arg){.i = i % DESKTOPS});
+        ev.xmaprequest = (XMapRequestEvent){ .type = MapRequest, .window = BENCH_WINDOW + i };
+        benchevent(&ev);
+    }
+    for (int i=0; i<n; i++, k += 4) {
+        Window w = BENCH_WINDOW + i;
+        ev.xconfigurerequest = (XConfigureRequestEvent){ .type = ConfigureRequest, .window = w,
+                .x = i % 64, .y = i % 48, .width = 640, .height = 480,
+                .value_mask = CWX|CWY|CWWidth|CWHeight };
+        benchevent(&ev);
+        ev.xproperty = (XPropertyEvent){ .type = PropertyNotify, .window = w, .atom = XA_WM_NAME };
+        benchevent(&ev);
+        ev.xclient = (XClientMessageEvent){ .type = ClientMessage, .window = w,
+                .message_type = netatoms[NET_ACTIVE], .format = 32 };
+        benchevent(&ev);
+        ev.xdestroywindow = (XDestroyWindowEvent){ .type = DestroyNotify, .window = w };
+        benchevent(&ev);
+    }
+    t = ustime() - t;
+    fprintf(stderr, "bench:%lu:%ld:%ld\n", k, t, t ? (long)(k*1000000/t):0);
+    for (int i=0; i<OP_COUNT; i++) if (ops[i]) fprintf(stderr, "mock:%s:%lu\n", opnames[i], ops[i]);
+    fflush(stderr);
+    running = False;
+}
+
+/* the windows soak() keeps coming and going, and how many samples it prints */
+#define SOAK_WINDOWS    64
+#define SOAK_SAMPLES    20
+
+/* drive SOAK_WINDOWS windows through the real handlers round after round,
+ * mapping each on the next desktop in turn, every fourth as a transient that
+ * floats, then retitling them, toggling every eighth into fullscreen and
+ * destroying them all, and print a sample every rounds/SOAK_SAMPLES rounds.
+ * the same windows come back every round, so the mock's memory stays flat
+ * and any growth is the wm's. the wm is stopped once done */
+static void soak(int rounds) {
+    XEvent ev;
+    char title[32];
+    int every = rounds < SOAK_SAMPLES ? 1:rounds/SOAK_SAMPLES;
+    for (int r=0; r<rounds; r++) {
+        for (int i=0; i<SOAK_WINDOWS; i++) {
+            Window w = BENCH_WINDOW + i;
+            long t = BENCH_WINDOW + i - 1;
+            mockChangeProperty(dis, w, XA_WM_TRANSIENT_FOR, XA_WINDOW, 32, PropModeReplace,
+                               (unsigned char *)&t, i % 4 == 3);
+            change_desktop(&(Arg){.i = i % DESKTOPS});
+            ev.xmaprequest = (XMapRequestEvent){ .type = MapRequest, .window = w };
+            benchevent(&ev);
+        }
+        for (int i=0; i<SOAK_WINDOWS; i++) {
+            Window w = BENCH_WINDOW + i;
+            snprintf(title, sizeof title, "soak %d of %d", r, i);
+            mockChangeProperty(dis, w, XA_WM_NAME, XA_STRING, 8, PropModeReplace,
+                               (unsigned char *)title, strlen(title));
+            ev.xproperty = (XPropertyEvent){ .type = PropertyNotify, .window = w, .atom = XA_WM_NAME };
+            benchevent(&ev);
+            if (i % 8) continue;
+            ev.xclient = (XClientMessageEvent){ .type = ClientMessage, .window = w, .format = 32,
+                    .message_type = netatoms[NET_WM_STATE], .data.l = { 2, netatoms[NET_FULLSCREEN] } };
+            benchevent(&ev);
+        }
+        for (int i=0; i<SOAK_WINDOWS; i++) {
+            ev.xdestroywindow = (XDestroyWindowEvent){ .type = DestroyNotify, .window = BENCH_WINDOW + i };
+            benchevent(&ev);
+        }
+        if ((r + 1) % every == 0) sample();
+    }
+    running = False;
+}
+#endif /* MOCK */
+
 int main(int argc, char *argv[]) {
     if (argc == 2 && !strncmp(argv[1], "-v", 3))
         errx(EXIT_SUCCESS, "version-%s - by c00kiemon5ter >:3 omnomnomnom", VERSION);
+#ifdef MOCK
+    else if (argc != 3 || (strcmp(argv[1], "-b") && strcmp(argv[1], "-s")) || atoi(argv[2]) <= 0)
+        errx(EXIT_FAILURE, "usage: monsterwm -b windows | -s rounds");
+    be = &mock;
+#else
     else if (argc != 1) errx(EXIT_FAILURE, "usage: man monsterwm");
     if (!(dis = XOpenDisplay(NULL))) errx(EXIT_FAILURE, "cannot open display");
+#endif
+    arguments = argv;
     setup();
     desktopinfo(); /* zero out every desktop on (re)start */
+#ifdef MOCK
+    if (argv[1][1] == 'b') bench(atoi(argv[2])); else soak(atoi(argv[2]));
+#endif
     run();
     cleanup();
+#ifndef MOCK
     XCloseDisplay(dis);
+#endif
     return retval;
 }
+
+#endif /* MODULE */
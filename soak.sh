@@ -0,0 +1,33 @@
+#!/bin/sh
+# soak test for monsterwm - see LICENSE for license and copyright information
+#
+# usage: soak.sh binary rounds
+#
+# runs the soak of a mock build, 'monsterwm -s rounds', and fails if it
+# crashes, if clients leak, or if the resident memory, the heap in use or
+# the 99th percentile of the event handling time trend upward. the first
+# sample is the warm up and left out, the means of the first and the second
+# half of the others are compared. the percentiles fall in power of two
+# buckets, so the latency may double and grow by 64 microseconds more
+
+[ $# -eq 2 ] || { echo "usage: $0 binary rounds" >&2; exit 2; }
+samples=$("$1" -s "$2" 2>&1 >/dev/null) || { echo "soak: $1 failed" >&2; exit 1; }
+
+printf '%s\n' "$samples" | awk -F: '
+$1 == "sample" && ++n > 1 { rss[n] = $3; heap[n] = $4; p99[n] = $10 }
+$1 == "sample" && $6 - $7 != $5 { leak = $6 - $7 - $5 }
+function mean(a, from, to,    i, sum) { for (i = from; i <= to; i++) sum += a[i]; return sum/(to - from + 1) }
+function check(name, a, grow, slack, unit,    h, early, late) {
+    h = int(n/2) + 1
+    early = mean(a, 2, h - 1); late = mean(a, h, n)
+    printf "soak: %s %d%s, then %d%s\n", name, early, unit, late, unit
+    if (late > early*(1 + grow) + slack) { print "soak: " name " trends upward"; failed = 1 }
+}
+END {
+    if (n < 5) { print "soak: too few samples, run more rounds"; exit 1 }
+    if (leak) { print "soak: " leak " clients leaked"; failed = 1 }
+    check("rss", rss, 0.05, 64, "kB")
+    check("heap", heap, 0.05, 64, "kB")
+    check("p99", p99, 1, 64, "us")
+    exit failed
+}' >&2